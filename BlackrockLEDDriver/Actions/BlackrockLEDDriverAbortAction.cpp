@@ -0,0 +1,28 @@
+//
+//  BlackrockLEDDriverAbortAction.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverAbortAction.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+void AbortAction::describeComponent(ComponentInfo &info) {
+    Action::describeComponent(info);
+    info.setSignature("action/blackrock_led_driver_abort");
+}
+
+
+bool AbortAction::execute() {
+    if (auto sharedDevice = weakDevice.lock()) {
+        sharedDevice->abort();
+    }
+    return true;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,32 @@
+//
+//  BlackrockLEDDriverAbortAction.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverAbortAction_hpp
+#define BlackrockLEDDriverAbortAction_hpp
+
+#include "BlackrockLEDDriverAction.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+class AbortAction : public Action {
+    
+public:
+    static void describeComponent(ComponentInfo &info);
+    
+    using Action::Action;
+    
+    bool execute() override;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverAbortAction_hpp */
@@ -33,4 +33,15 @@ Action::Action(const ParameterValueMap &parameters) :
 }
 
 
+void Action::stageConstantDuration(const VariablePtr &duration) const {
+    // Reject an invalid constant duration when the experiment loads, rather than when the action
+    // executes
+    if (boost::dynamic_pointer_cast<ConstantVariable>(duration)) {
+        if (auto sharedDevice = weakDevice.lock()) {
+            sharedDevice->stageDuration(duration->getValue().getInteger());
+        }
+    }
+}
+
+
 END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
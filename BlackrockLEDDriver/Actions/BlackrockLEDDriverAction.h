@@ -25,6 +25,8 @@ public:
     explicit Action(const ParameterValueMap &parameters);
     
 protected:
+    void stageConstantDuration(const VariablePtr &duration) const;
+    
     const boost::weak_ptr<Device> weakDevice;
     
 };
@@ -27,7 +27,9 @@ void PrepareAction::describeComponent(ComponentInfo &info) {
 PrepareAction::PrepareAction(const ParameterValueMap &parameters) :
     Action(parameters),
     duration(parameters[DURATION])
-{ }
+{
+    stageConstantDuration(duration);
+}
 
 
 bool PrepareAction::execute() {
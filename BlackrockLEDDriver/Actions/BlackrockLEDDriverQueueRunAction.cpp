@@ -0,0 +1,45 @@
+//
+//  BlackrockLEDDriverQueueRunAction.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverQueueRunAction.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+const std::string QueueRunAction::DURATION("duration");
+const std::string QueueRunAction::GAP("gap");
+
+
+void QueueRunAction::describeComponent(ComponentInfo &info) {
+    Action::describeComponent(info);
+    
+    info.setSignature("action/blackrock_led_driver_queue_run");
+    
+    info.addParameter(DURATION);
+    info.addParameter(GAP, "0");
+}
+
+
+QueueRunAction::QueueRunAction(const ParameterValueMap &parameters) :
+    Action(parameters),
+    duration(parameters[DURATION]),
+    gap(parameters[GAP])
+{
+    stageConstantDuration(duration);
+}
+
+
+bool QueueRunAction::execute() {
+    if (auto sharedDevice = weakDevice.lock()) {
+        sharedDevice->queueRun(duration->getValue().getInteger(), gap->getValue().getInteger());
+    }
+    return true;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
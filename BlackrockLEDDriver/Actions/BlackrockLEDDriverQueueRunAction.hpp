@@ -0,0 +1,39 @@
+//
+//  BlackrockLEDDriverQueueRunAction.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverQueueRunAction_hpp
+#define BlackrockLEDDriverQueueRunAction_hpp
+
+#include "BlackrockLEDDriverAction.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+class QueueRunAction : public Action {
+    
+public:
+    static const std::string DURATION;
+    static const std::string GAP;
+    
+    static void describeComponent(ComponentInfo &info);
+    
+    explicit QueueRunAction(const ParameterValueMap &parameters);
+    
+    bool execute() override;
+    
+private:
+    const VariablePtr duration;
+    const VariablePtr gap;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverQueueRunAction_hpp */
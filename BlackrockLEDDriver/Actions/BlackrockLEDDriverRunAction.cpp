@@ -27,7 +27,9 @@ void RunAction::describeComponent(ComponentInfo &info) {
 RunAction::RunAction(const ParameterValueMap &parameters) :
     Action(parameters),
     duration(parameters[DURATION])
-{ }
+{
+    stageConstantDuration(duration);
+}
 
 
 bool RunAction::execute() {
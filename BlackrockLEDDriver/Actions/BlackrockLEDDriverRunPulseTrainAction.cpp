@@ -0,0 +1,108 @@
+//
+//  BlackrockLEDDriverRunPulseTrainAction.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverRunPulseTrainAction.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+const std::string RunPulseTrainAction::CHANNELS("channels");
+const std::string RunPulseTrainAction::FREQUENCY("frequency");
+const std::string RunPulseTrainAction::PULSE_WIDTH("pulse_width");
+const std::string RunPulseTrainAction::COUNT("count");
+const std::string RunPulseTrainAction::DURATION("duration");
+const std::string RunPulseTrainAction::PHASE_OFFSETS("phase_offsets");
+const std::string RunPulseTrainAction::TIMING_ERROR("timing_error");
+
+
+void RunPulseTrainAction::describeComponent(ComponentInfo &info) {
+    Action::describeComponent(info);
+    
+    info.setSignature("action/blackrock_led_driver_run_pulse_train");
+    
+    info.addParameter(CHANNELS);
+    info.addParameter(FREQUENCY);
+    info.addParameter(PULSE_WIDTH);
+    info.addParameter(COUNT, false);
+    info.addParameter(DURATION, false);
+    info.addParameter(PHASE_OFFSETS, false);
+    info.addParameter(TIMING_ERROR, false);
+}
+
+
+RunPulseTrainAction::RunPulseTrainAction(const ParameterValueMap &parameters) :
+    Action(parameters),
+    channelList(ParsedExpressionVariable::parseExpressionList(parameters[CHANNELS].str())),
+    frequency(parameters[FREQUENCY]),
+    pulseWidth(parameters[PULSE_WIDTH]),
+    count(optionalVariable(parameters[COUNT])),
+    duration(optionalVariable(parameters[DURATION])),
+    phaseOffsetList(parameters[PHASE_OFFSETS].empty() ?
+                    stx::ParseTreeList() :
+                    ParsedExpressionVariable::parseExpressionList(parameters[PHASE_OFFSETS].str())),
+    timingError(optionalVariable(parameters[TIMING_ERROR]))
+{
+    if (bool(count) == bool(duration)) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver pulse train requires either %s or %s, but not both")
+                               % COUNT
+                               % DURATION).str());
+    }
+}
+
+
+bool RunPulseTrainAction::execute() {
+    if (auto sharedDevice = weakDevice.lock()) {
+        std::vector<Datum> channelNums;
+        ParsedExpressionVariable::evaluateParseTreeList(channelList, channelNums);
+        
+        std::vector<Datum> phaseOffsets;
+        ParsedExpressionVariable::evaluateParseTreeList(phaseOffsetList, phaseOffsets);
+        if (phaseOffsets.size() > 1 && phaseOffsets.size() != channelNums.size()) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN,
+                   "LED driver pulse train requires one phase offset, or one per channel (got %lu for %lu "
+                   "channels)",
+                   phaseOffsets.size(),
+                   channelNums.size());
+            return true;
+        }
+        
+        PulseTrainSpec spec;
+        spec.frequency = frequency->getValue().getFloat();
+        spec.pulseWidth = pulseWidth->getValue().getInteger();
+        if (count) {
+            spec.pulseCount = std::max(0LL, count->getValue().getInteger());
+        } else {
+            // Include every pulse that starts within the duration
+            const double trainDuration = double(duration->getValue().getInteger());
+            spec.pulseCount = std::max(0.0, std::ceil(trainDuration * spec.frequency / 1e6 - 1e-9));
+        }
+        
+        for (std::size_t i = 0; i < channelNums.size(); i++) {
+            const auto channelNum = channelNums[i].getInteger();
+            if (channelNum < 1 || std::size_t(channelNum) > numChannels) {
+                merror(M_IODEVICE_MESSAGE_DOMAIN, "Invalid LED driver channel number: %lld", channelNum);
+                return true;
+            }
+            spec.channels[channelNum - 1] = true;
+            if (!phaseOffsets.empty()) {
+                spec.phaseOffset[channelNum - 1] = phaseOffsets[(phaseOffsets.size() > 1) ? i : 0].getInteger();
+            }
+        }
+        
+        MWTime achievedTimingError;
+        if (sharedDevice->runPulseTrain(spec, achievedTimingError) && timingError) {
+            timingError->setValue(achievedTimingError);
+        }
+    }
+    
+    return true;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
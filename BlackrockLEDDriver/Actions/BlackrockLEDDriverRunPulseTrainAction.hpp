@@ -0,0 +1,49 @@
+//
+//  BlackrockLEDDriverRunPulseTrainAction.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverRunPulseTrainAction_hpp
+#define BlackrockLEDDriverRunPulseTrainAction_hpp
+
+#include "BlackrockLEDDriverAction.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+class RunPulseTrainAction : public Action {
+    
+public:
+    static const std::string CHANNELS;
+    static const std::string FREQUENCY;
+    static const std::string PULSE_WIDTH;
+    static const std::string COUNT;
+    static const std::string DURATION;
+    static const std::string PHASE_OFFSETS;
+    static const std::string TIMING_ERROR;
+    
+    static void describeComponent(ComponentInfo &info);
+    
+    explicit RunPulseTrainAction(const ParameterValueMap &parameters);
+    
+    bool execute() override;
+    
+private:
+    const stx::ParseTreeList channelList;
+    const VariablePtr frequency;
+    const VariablePtr pulseWidth;
+    const VariablePtr count;
+    const VariablePtr duration;
+    const stx::ParseTreeList phaseOffsetList;
+    const VariablePtr timingError;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverRunPulseTrainAction_hpp */
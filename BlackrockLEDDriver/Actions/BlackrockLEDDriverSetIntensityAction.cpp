@@ -32,7 +32,14 @@ SetIntensityAction::SetIntensityAction(const ParameterValueMap &parameters) :
     Action(parameters),
     channelList(ParsedExpressionVariable::parseExpressionList(parameters[CHANNELS].str())),
     value(parameters[VALUE])
-{ }
+{
+    if (boost::dynamic_pointer_cast<ConstantVariable>(value)) {
+        const double constantValue = value->getValue().getFloat();
+        if (constantValue < 0.0 || constantValue > 1.0) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "LED driver channel intensity must be between 0 and 1");
+        }
+    }
+}
 
 
 bool SetIntensityAction::execute() {
@@ -0,0 +1,117 @@
+//
+//  BlackrockLEDDriverSetPatternAction.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverSetPatternAction.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+const std::string SetPatternAction::SHAPE("shape");
+const std::string SetPatternAction::CENTER_X("center_x");
+const std::string SetPatternAction::CENTER_Y("center_y");
+const std::string SetPatternAction::SIZE("size");
+const std::string SetPatternAction::ANGLE("angle");
+const std::string SetPatternAction::VALUE("value");
+const std::string SetPatternAction::IMAGE("image");
+
+
+void SetPatternAction::describeComponent(ComponentInfo &info) {
+    Action::describeComponent(info);
+    
+    info.setSignature("action/blackrock_led_driver_set_pattern");
+    
+    info.addParameter(SHAPE);
+    info.addParameter(CENTER_X, "0");
+    info.addParameter(CENTER_Y, "0");
+    info.addParameter(SIZE, false);
+    info.addParameter(ANGLE, "0");
+    info.addParameter(VALUE, "1");
+    info.addParameter(IMAGE, false);
+}
+
+
+static PatternSpec::Shape shapeParameter(const ParameterValue &param) {
+    const auto value = boost::algorithm::to_lower_copy(param.str());
+    
+    if (value == "spot") {
+        return PatternSpec::Shape::Spot;
+    } else if (value == "bar") {
+        return PatternSpec::Shape::Bar;
+    } else if (value == "gradient") {
+        return PatternSpec::Shape::Gradient;
+    } else if (value == "image") {
+        return PatternSpec::Shape::Image;
+    }
+    
+    throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "Invalid LED driver pattern shape", value);
+}
+
+
+SetPatternAction::SetPatternAction(const ParameterValueMap &parameters) :
+    Action(parameters),
+    shape(shapeParameter(parameters[SHAPE])),
+    centerX(parameters[CENTER_X]),
+    centerY(parameters[CENTER_Y]),
+    size(optionalVariable(parameters[SIZE])),
+    angle(parameters[ANGLE]),
+    value(parameters[VALUE]),
+    image(optionalVariable(parameters[IMAGE]))
+{
+    if (shape == PatternSpec::Shape::Image) {
+        if (!image) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver image pattern requires %s") % IMAGE).str());
+        }
+    } else if (!size) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver %s pattern requires %s")
+                               % parameters[SHAPE].str()
+                               % SIZE).str());
+    }
+}
+
+
+bool SetPatternAction::execute() {
+    if (auto sharedDevice = weakDevice.lock()) {
+        PatternSpec spec;
+        spec.shape = shape;
+        spec.centerX = centerX->getValue().getFloat();
+        spec.centerY = centerY->getValue().getFloat();
+        spec.angle = angle->getValue().getFloat();
+        spec.value = value->getValue().getFloat();
+        
+        if (size) {
+            spec.size = size->getValue().getFloat();
+        }
+        
+        if (image) {
+            const auto imageValue = image->getValue();
+            if (!imageValue.isList()) {
+                merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver pattern image must be a list of rows");
+                return true;
+            }
+            for (auto &rowValue : imageValue.getList()) {
+                if (!rowValue.isList()) {
+                    merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver pattern image must be a list of rows");
+                    return true;
+                }
+                spec.image.emplace_back();
+                for (auto &pixel : rowValue.getList()) {
+                    spec.image.back().push_back(pixel.getFloat());
+                }
+            }
+        }
+        
+        sharedDevice->setPattern(spec);
+    }
+    
+    return true;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,49 @@
+//
+//  BlackrockLEDDriverSetPatternAction.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverSetPatternAction_hpp
+#define BlackrockLEDDriverSetPatternAction_hpp
+
+#include "BlackrockLEDDriverAction.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+class SetPatternAction : public Action {
+    
+public:
+    static const std::string SHAPE;
+    static const std::string CENTER_X;
+    static const std::string CENTER_Y;
+    static const std::string SIZE;
+    static const std::string ANGLE;
+    static const std::string VALUE;
+    static const std::string IMAGE;
+    
+    static void describeComponent(ComponentInfo &info);
+    
+    explicit SetPatternAction(const ParameterValueMap &parameters);
+    
+    bool execute() override;
+    
+private:
+    const PatternSpec::Shape shape;
+    const VariablePtr centerX;
+    const VariablePtr centerY;
+    const VariablePtr size;
+    const VariablePtr angle;
+    const VariablePtr value;
+    const VariablePtr image;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverSetPatternAction_hpp */
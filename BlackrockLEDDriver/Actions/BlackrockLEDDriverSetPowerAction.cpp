@@ -0,0 +1,52 @@
+//
+//  BlackrockLEDDriverSetPowerAction.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverSetPowerAction.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+const std::string SetPowerAction::CHANNELS("channels");
+const std::string SetPowerAction::POWER("power");
+
+
+void SetPowerAction::describeComponent(ComponentInfo &info) {
+    Action::describeComponent(info);
+    
+    info.setSignature("action/blackrock_led_driver_set_power");
+    
+    info.addParameter(CHANNELS);
+    info.addParameter(POWER);
+}
+
+
+SetPowerAction::SetPowerAction(const ParameterValueMap &parameters) :
+    Action(parameters),
+    channelList(ParsedExpressionVariable::parseExpressionList(parameters[CHANNELS].str())),
+    power(parameters[POWER])
+{ }
+
+
+bool SetPowerAction::execute() {
+    if (auto sharedDevice = weakDevice.lock()) {
+        std::vector<Datum> channelNums;
+        ParsedExpressionVariable::evaluateParseTreeList(channelList, channelNums);
+        
+        std::set<int> channels;
+        for (auto &channelNum : channelNums) {
+            channels.insert(channelNum.getInteger());
+        }
+        
+        sharedDevice->setPower(channels, power->getValue().getFloat());
+    }
+    
+    return true;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,39 @@
+//
+//  BlackrockLEDDriverSetPowerAction.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverSetPowerAction_hpp
+#define BlackrockLEDDriverSetPowerAction_hpp
+
+#include "BlackrockLEDDriverAction.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+class SetPowerAction : public Action {
+    
+public:
+    static const std::string CHANNELS;
+    static const std::string POWER;
+    
+    static void describeComponent(ComponentInfo &info);
+    
+    explicit SetPowerAction(const ParameterValueMap &parameters);
+    
+    bool execute() override;
+    
+private:
+    const stx::ParseTreeList channelList;
+    const VariablePtr power;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverSetPowerAction_hpp */
@@ -0,0 +1,138 @@
+//
+//  BlackrockLEDDriverCalibration.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverCalibration.hpp"
+
+#include <fstream>
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+IntensityCalibration::IntensityCalibration(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "Cannot open LED driver calibration file", path);
+    }
+    
+    // Read (power, drive) points for each channel
+    std::array<std::vector<std::pair<double, double>>, numChannels> points;
+    std::string line;
+    std::size_t lineNumber = 0;
+    
+    while (std::getline(file, line)) {
+        lineNumber++;
+        
+        line = line.substr(0, line.find('#'));
+        std::replace(line.begin(), line.end(), ',', ' ');
+        boost::algorithm::trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        
+        std::istringstream is(line);
+        int channelNum;
+        double power, drive;
+        if (!(is >> channelNum >> power >> drive) || !(is >> std::ws).eof()) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("Invalid entry in LED driver calibration file (line %d)")
+                                   % lineNumber).str(),
+                                  path);
+        }
+        
+        if (channelNum < 1 || std::size_t(channelNum) > numChannels) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("Invalid LED driver channel number in calibration file (line %d)")
+                                   % lineNumber).str(),
+                                  path);
+        }
+        
+        if (power < 0.0 || drive < 0.0 || drive > 1.0) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver calibration power must be non-negative, and drive must "
+                                                 "be between 0 and 1 (line %d)")
+                                   % lineNumber).str(),
+                                  path);
+        }
+        
+        auto &channelPoints = points[channelNum - 1];
+        if (!channelPoints.empty() && (power <= channelPoints.back().first || drive < channelPoints.back().second)) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver calibration points for channel %d must have increasing "
+                                                 "power and non-decreasing drive (line %d)")
+                                   % channelNum
+                                   % lineNumber).str(),
+                                  path);
+        }
+        channelPoints.emplace_back(power, drive);
+    }
+    
+    for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+        auto &channelPoints = points[channelIndex];
+        
+        if (channelPoints.empty()) {
+            maxPower[channelIndex] = 0.0;
+            continue;
+        }
+        
+        // Zero power always means off
+        if (channelPoints.front().first > 0.0) {
+            channelPoints.emplace(channelPoints.begin(), 0.0, 0.0);
+        }
+        if (channelPoints.size() < 2) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver calibration for channel %d requires a point with "
+                                                 "non-zero power")
+                                   % (channelIndex + 1)).str(),
+                                  path);
+        }
+        
+        maxPower[channelIndex] = channelPoints.back().first;
+        for (const auto &point : channelPoints) {
+            pointPower[channelIndex].push_back(point.first);
+            pointDrive[channelIndex].push_back(point.second);
+        }
+    }
+}
+
+
+void IntensityCalibration::apply(const std::array<double, numChannels> &power,
+                                 const std::array<BYTE, numChannels> &mask,
+                                 std::array<WordValue, numChannels> &words) const
+{
+    for (std::size_t i = 0; i < numChannels; i++) {
+        if (mask[i]) {
+            words[i] = WORD(std::round(getDrive(i, power[i]) * double(std::numeric_limits<WORD>::max())));
+        }
+    }
+}
+
+
+double IntensityCalibration::getDrive(std::size_t channelIndex, double power) const {
+    const auto &powers = pointPower[channelIndex];
+    const auto &drives = pointDrive[channelIndex];
+    if (powers.empty()) {
+        return 0.0;
+    }
+    
+    // Find the last point at or below the requested power.  Landing on a point returns its drive
+    // unchanged, with no interpolation error.
+    const auto upper = std::upper_bound(powers.begin(), powers.end(), power);
+    if (upper == powers.begin()) {
+        return drives.front();
+    }
+    const std::size_t lower = (upper - powers.begin()) - 1;
+    if (lower + 1 == powers.size() || powers[lower] == power) {
+        return drives[lower];
+    }
+    
+    const double fraction = (power - powers[lower]) / (powers[lower + 1] - powers[lower]);
+    return drives[lower] + fraction * (drives[lower + 1] - drives[lower]);
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,48 @@
+//
+//  BlackrockLEDDriverCalibration.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverCalibration_hpp
+#define BlackrockLEDDriverCalibration_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Per-channel mapping from optical power to drive level, loaded from a text file.  Powers are
+// interpolated linearly between the stored calibration points, so a power equal to a measured
+// point maps to exactly that point's drive.
+//
+class IntensityCalibration : boost::noncopyable {
+    
+public:
+    explicit IntensityCalibration(const std::string &path);
+    
+    bool isCalibrated(std::size_t channelIndex) const { return maxPower[channelIndex] > 0.0; }
+    double getMaxPower(std::size_t channelIndex) const { return maxPower[channelIndex]; }
+    
+    // Converts power to drive words for every channel whose mask entry is non-zero
+    void apply(const std::array<double, numChannels> &power,
+               const std::array<BYTE, numChannels> &mask,
+               std::array<WordValue, numChannels> &words) const;
+    
+private:
+    double getDrive(std::size_t channelIndex, double power) const;
+    
+    std::array<double, numChannels> maxPower;  // Exactly as given in the file, for range checks
+    std::array<std::vector<double>, numChannels> pointPower;  // Increasing, starting at zero
+    std::array<std::vector<double>, numChannels> pointDrive;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverCalibration_hpp */
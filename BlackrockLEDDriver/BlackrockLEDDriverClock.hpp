@@ -0,0 +1,86 @@
+//
+//  BlackrockLEDDriverClock.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverClock_hpp
+#define BlackrockLEDDriverClock_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Time source for the device.  All device timing (run start and stop times, waits, and thermal
+// predictions) goes through this interface, so that a simulated device can run on virtual time.
+//
+class DeviceClock : boost::noncopyable {
+    
+public:
+    virtual ~DeviceClock() { }
+    
+    virtual MWTime getCurrentTimeUS() = 0;
+    virtual void sleepUS(MWTime time) = 0;
+    
+    // Returns true if waits should be skipped by calling advanceTo, instead of actually waiting
+    virtual bool isVirtual() const = 0;
+    virtual void advanceTo(MWTime time) = 0;
+    
+};
+
+
+class RealTimeClock : public DeviceClock {
+    
+public:
+    RealTimeClock() : clock(Clock::instance()) { }
+    
+    MWTime getCurrentTimeUS() override { return clock->getCurrentTimeUS(); }
+    void sleepUS(MWTime time) override { clock->sleepUS(time); }
+    
+    bool isVirtual() const override { return false; }
+    void advanceTo(MWTime) override { }
+    
+private:
+    const boost::shared_ptr<Clock> clock;
+    
+};
+
+
+//
+// Follows the MWorks clock, plus an offset that grows whenever the device sleeps or advances to a
+// future event.  Time never runs backwards.
+//
+class VirtualClock : public DeviceClock {
+    
+public:
+    VirtualClock() : clock(Clock::instance()), offset(0) { }
+    
+    MWTime getCurrentTimeUS() override { return clock->getCurrentTimeUS() + offset; }
+    void sleepUS(MWTime time) override { advanceTo(getCurrentTimeUS() + time); }
+    
+    bool isVirtual() const override { return true; }
+    
+    void advanceTo(MWTime time) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        const MWTime currentTime = getCurrentTimeUS();
+        if (time > currentTime) {
+            offset += time - currentTime;
+        }
+    }
+    
+private:
+    const boost::shared_ptr<Clock> clock;
+    std::mutex mutex;
+    std::atomic<MWTime> offset;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverClock_hpp */
@@ -37,18 +37,42 @@ constexpr MWTime minDuration = minPeriod;
 constexpr MWTime maxDuration = maxPeriod * numSamples;
 
 
+//
+// Byte stream between the host and the LED driver.  Implementations report their own errors.  A read
+// and a write may run concurrently on different threads, but never two reads or two writes.
+//
+class Transport : boost::noncopyable {
+    
+public:
+    virtual ~Transport() { }
+    
+    virtual bool read(BYTE *data, std::size_t size) = 0;
+    virtual bool write(const BYTE *data, std::size_t size) = 0;
+    virtual void purge() = 0;
+    
+};
+
+
 struct EmptyMessageBody { };
 
 
+// Complete frame, including checksum, of a message with no body
+template<BYTE c0, BYTE c1, BYTE c2>
+struct ConstantFrame {
+    static constexpr std::array<BYTE, 4> bytes() { return {{ c0, c1, c2, BYTE(c0 + c1 + c2) }}; }
+};
+
+
 template<BYTE c0, BYTE c1, BYTE c2, typename Body = EmptyMessageBody>
 struct Message {
     
     const Body& getBody() const { return bodyAndChecksum; }
     Body& getBody() { return const_cast<Body &>(static_cast<const Message &>(*this).getBody()); }
     
-    bool read(FT_HANDLE handle, std::size_t bytesAlreadyRead = 0);
-    bool write(FT_HANDLE handle);
+    bool read(Transport &transport, std::size_t bytesAlreadyRead = 0);
+    bool write(Transport &transport) { return write(transport, std::is_empty<Body>()); }
     
+    static constexpr BYTE commandCode() { return c2; }
     static constexpr std::size_t size() { return sizeof(Message); }
     
     const BYTE* data() const { return reinterpret_cast<const BYTE *>(this); };
@@ -58,10 +82,12 @@ struct Message {
     const_iterator begin() const { return data(); }
     const_iterator end() const { return begin() + size(); }
     
-    std::string hex() const {
+    std::string hex() const { return hex(data()); }
+    
+    static std::string hex(const BYTE *frame) {
         std::ostringstream os;
-        for (BYTE byte : *this) {
-            os << std::hex << std::setfill('0') << std::setw(2) << int(byte) << ' ';
+        for (std::size_t i = 0; i < size(); i++) {
+            os << std::hex << std::setfill('0') << std::setw(2) << int(frame[i]) << ' ';
         }
         auto str = os.str();
         if (str.size() > maxHexLength) {
@@ -72,6 +98,10 @@ struct Message {
     }
     
 private:
+    bool write(Transport &transport, std::true_type bodyIsEmpty);
+    bool write(Transport &transport, std::false_type bodyIsEmpty);
+    bool send(Transport &transport, const BYTE *frame);
+    
     BYTE computeChecksum() const {
         return std::accumulate(begin(), end() - 1, BYTE(0));
     }
@@ -96,33 +126,17 @@ private:
 
 
 template<BYTE c0, BYTE c1, BYTE c2, typename Body>
-bool Message<c0, c1, c2, Body>::read(FT_HANDLE handle, std::size_t bytesAlreadyRead) {
-    FT_STATUS status;
-    const std::size_t bytesToRead = size() - bytesAlreadyRead;
-    DWORD bytesRead;
-    
+bool Message<c0, c1, c2, Body>::read(Transport &transport, std::size_t bytesAlreadyRead) {
 #ifdef MW_BLACKROCK_LEDDRIVER_DEBUG
     MWTime beforeRead = Clock::instance()->getCurrentTimeUS();
 #endif
     
-    if (FT_OK != (status = FT_Read(handle, data() + bytesAlreadyRead, bytesToRead, &bytesRead))) {
-        merror(M_IODEVICE_MESSAGE_DOMAIN, "Read from LED driver failed (status: %d)", status);
+    if (!transport.read(data() + bytesAlreadyRead, size() - bytesAlreadyRead)) {
         return false;
     }
     
 #ifdef MW_BLACKROCK_LEDDRIVER_DEBUG
     MWTime afterRead = Clock::instance()->getCurrentTimeUS();
-#endif
-    
-    if (bytesRead != bytesToRead) {
-        merror(M_IODEVICE_MESSAGE_DOMAIN,
-               "Incomplete read from LED driver (requested %lu bytes, read %d)",
-               bytesToRead,
-               bytesRead);
-        return false;
-    }
-    
-#ifdef MW_BLACKROCK_LEDDRIVER_DEBUG
     mprintf(M_IODEVICE_MESSAGE_DOMAIN,
             "RECV: %s (took %g ms)",
             hex().c_str(),
@@ -133,9 +147,7 @@ bool Message<c0, c1, c2, Body>::read(FT_HANDLE handle, std::size_t bytesAlreadyR
         merror(M_IODEVICE_MESSAGE_DOMAIN, "Unexpected message from LED driver");
         
         // Attempt to recover by purging the receive buffer
-        if (FT_OK != (status = FT_Purge(handle, FT_PURGE_RX))) {
-            merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot purge LED driver receive buffer (status: %d)", status);
-        }
+        transport.purge();
         
         return false;
     }
@@ -149,39 +161,38 @@ bool Message<c0, c1, c2, Body>::read(FT_HANDLE handle, std::size_t bytesAlreadyR
 }
 
 
+// Requests without a body never vary, so send a frame that was assembled at compile time
 template<BYTE c0, BYTE c1, BYTE c2, typename Body>
-bool Message<c0, c1, c2, Body>::write(FT_HANDLE handle) {
+bool Message<c0, c1, c2, Body>::write(Transport &transport, std::true_type) {
+    static constexpr auto frame = ConstantFrame<c0, c1, c2>::bytes();
+    BOOST_STATIC_ASSERT(frame.size() == size());
+    return send(transport, frame.data());
+}
+
+
+template<BYTE c0, BYTE c1, BYTE c2, typename Body>
+bool Message<c0, c1, c2, Body>::write(Transport &transport, std::false_type) {
     command = { c0, c1, c2 };
     bodyAndChecksum.checksum = computeChecksum();
-    
-    FT_STATUS status;
-    DWORD bytesWritten;
-    
+    return send(transport, data());
+}
+
+
+template<BYTE c0, BYTE c1, BYTE c2, typename Body>
+bool Message<c0, c1, c2, Body>::send(Transport &transport, const BYTE *frame) {
 #ifdef MW_BLACKROCK_LEDDRIVER_DEBUG
     MWTime beforeWrite = Clock::instance()->getCurrentTimeUS();
 #endif
     
-    if (FT_OK != (status = FT_Write(handle, data(), size(), &bytesWritten))) {
-        merror(M_IODEVICE_MESSAGE_DOMAIN, "Write to LED driver failed (status: %d)", status);
+    if (!transport.write(frame, size())) {
         return false;
     }
     
 #ifdef MW_BLACKROCK_LEDDRIVER_DEBUG
     MWTime afterWrite = Clock::instance()->getCurrentTimeUS();
-#endif
-    
-    if (bytesWritten != size()) {
-        merror(M_IODEVICE_MESSAGE_DOMAIN,
-               "Incomplete write to LED driver (attempted %lu bytes, wrote %d)",
-               size(),
-               bytesWritten);
-        return false;
-    }
-    
-#ifdef MW_BLACKROCK_LEDDRIVER_DEBUG
     mprintf(M_IODEVICE_MESSAGE_DOMAIN,
             "SEND: %s (took %g ms)",
-            hex().c_str(),
+            hex(frame).c_str(),
             double(afterWrite - beforeWrite) / 1e3);
 #endif
     
@@ -256,6 +267,150 @@ struct ThermistorValuesResponseBody {
 using ThermistorValuesResponse = Message<0x05, 0x05, 0x80, ThermistorValuesResponseBody>;
 
 
+//
+// Protocol description.  Each command pairs a request with the response the driver sends back.
+//
+
+
+template<typename RequestType, typename ResponseType>
+struct CommandSpec {
+    using Request = RequestType;
+    using Response = ResponseType;
+    
+    static constexpr BYTE code() { return Request::commandCode(); }
+    BOOST_STATIC_ASSERT(Request::commandCode() == Response::commandCode());
+};
+
+
+struct LoadFileCommand : CommandSpec<LoadFileRequest, LoadFileResponse> {
+    static const char * name() { return "LoadFile"; }
+};
+
+
+struct SetFileTimePeriodCommand : CommandSpec<SetFileTimePeriodMessage, SetFileTimePeriodMessage> {
+    static const char * name() { return "SetFileTimePeriod"; }
+};
+
+
+struct StartFilePlayingCommand : CommandSpec<StartFilePlayingRequest, StartFilePlayingResponse> {
+    static const char * name() { return "StartFilePlaying"; }
+};
+
+
+struct IsFilePlayingCommand : CommandSpec<IsFilePlayingRequest, IsFilePlayingResponse> {
+    static const char * name() { return "IsFilePlaying"; }
+};
+
+
+struct StopFilePlayingCommand : CommandSpec<StopFilePlayingRequest, StopFilePlayingResponse> {
+    static const char * name() { return "StopFilePlaying"; }
+};
+
+
+struct ThermistorValuesCommand : CommandSpec<ThermistorValuesRequest, ThermistorValuesResponse> {
+    static const char * name() { return "ThermistorValues"; }
+};
+
+
+// Frame sizes documented in commands.txt (3 command bytes + body + checksum)
+BOOST_STATIC_ASSERT(LoadFileRequest::size() == 3 + numSamples * numChannels * 2 + 1);
+BOOST_STATIC_ASSERT(LoadFileResponse::size() == 5);
+BOOST_STATIC_ASSERT(SetFileTimePeriodMessage::size() == 6);
+BOOST_STATIC_ASSERT(StartFilePlayingRequest::size() == 4);
+BOOST_STATIC_ASSERT(StartFilePlayingResponse::size() == 5);
+BOOST_STATIC_ASSERT(IsFilePlayingRequest::size() == 4);
+BOOST_STATIC_ASSERT(IsFilePlayingResponse::size() == 5);
+BOOST_STATIC_ASSERT(StopFilePlayingRequest::size() == 4);
+BOOST_STATIC_ASSERT(StopFilePlayingResponse::size() == 5);
+BOOST_STATIC_ASSERT(ThermistorValuesRequest::size() == 4);
+BOOST_STATIC_ASSERT(ThermistorValuesResponse::size() == 12);
+
+
+struct CommandInfo {
+    BYTE code;
+    const char *name;
+    std::size_t requestSize;
+    std::size_t responseSize;
+};
+
+
+template<typename Request, typename... Commands>
+struct FindCommand {
+    using type = void;
+};
+
+
+template<typename Request, typename First, typename... Rest>
+struct FindCommand<Request, First, Rest...> {
+    using type = typename std::conditional<std::is_same<Request, typename First::Request>::value,
+                                           First,
+                                           typename FindCommand<Request, Rest...>::type>::type;
+};
+
+
+template<typename Request, typename... Commands>
+struct FindCommandIndex : std::integral_constant<std::size_t, 0> { };
+
+
+template<typename Request, typename First, typename... Rest>
+struct FindCommandIndex<Request, First, Rest...> :
+    std::integral_constant<std::size_t,
+                           (std::is_same<Request, typename First::Request>::value ?
+                            0 :
+                            1 + FindCommandIndex<Request, Rest...>::value)>
+{ };
+
+
+template<typename... Commands>
+struct ProtocolTable {
+    
+    static constexpr std::size_t size() { return sizeof...(Commands); }
+    
+    static constexpr std::array<BYTE, sizeof...(Commands)> codes() { return {{ Commands::code()... }}; }
+    
+    //
+    // Invokes handler with a default-constructed instance of the CommandSpec whose code matches
+    // the given one.  Returns false if the code is unknown.
+    //
+    template<typename Handler>
+    static bool dispatch(BYTE code, Handler &&handler) {
+        bool handled = false;
+        using expander = int[];
+        (void)expander{ 0, (handled = handled || (code == Commands::code() && (handler(Commands()), true)))... };
+        return handled;
+    }
+    
+    static bool lookup(BYTE code, CommandInfo &info) {
+        return dispatch(code, [&info](auto command) {
+            using Command = decltype(command);
+            info = { Command::code(), Command::name(), Command::Request::size(), Command::Response::size() };
+        });
+    }
+    
+    // Maps a request type to its command (and that command's position in the table).  Fails to
+    // compile if the request isn't in the table.
+    template<typename Request>
+    struct CommandFor {
+        using type = typename FindCommand<Request, Commands...>::type;
+        BOOST_STATIC_ASSERT(!std::is_void<type>::value);
+        static constexpr std::size_t index = FindCommandIndex<Request, Commands...>::value;
+    };
+    
+};
+
+
+using Protocol = ProtocolTable<LoadFileCommand,
+                               SetFileTimePeriodCommand,
+                               StartFilePlayingCommand,
+                               IsFilePlayingCommand,
+                               StopFilePlayingCommand,
+                               ThermistorValuesCommand>;
+
+
+template<typename Request>
+using ResponseFor = typename Protocol::CommandFor<Request>::type::Response;
+
+
 END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
 
 
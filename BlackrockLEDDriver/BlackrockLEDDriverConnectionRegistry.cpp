@@ -0,0 +1,55 @@
+//
+//  BlackrockLEDDriverConnectionRegistry.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverConnectionRegistry.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+ConnectionRegistry& ConnectionRegistry::instance() {
+    // Intentionally leaked (see class comment)
+    static ConnectionRegistry *registry = new ConnectionRegistry();
+    return *registry;
+}
+
+
+void ConnectionRegistry::retain(const std::string &identity, const RetainedConnection &connection) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto result = connections.emplace(identity, connection);
+    if (!result.second) {
+        close(result.first->second);
+        result.first->second = connection;
+    }
+}
+
+
+bool ConnectionRegistry::take(const std::string &identity, RetainedConnection &connection) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto iter = connections.find(identity);
+    if (iter == connections.end()) {
+        return false;
+    }
+    
+    connection = iter->second;
+    connections.erase(iter);
+    
+    return true;
+}
+
+
+void ConnectionRegistry::close(const RetainedConnection &connection) {
+    FT_STATUS status = FT_Close(connection.handle);
+    if (FT_OK != status) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot close LED driver (status: %d)", status);
+    }
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
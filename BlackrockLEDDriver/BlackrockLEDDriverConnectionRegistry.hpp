@@ -0,0 +1,64 @@
+//
+//  BlackrockLEDDriverConnectionRegistry.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverConnectionRegistry_hpp
+#define BlackrockLEDDriverConnectionRegistry_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// An open driver connection left behind by an unloaded experiment, along with what it knows about
+// the file on the driver
+//
+struct RetainedConnection {
+    FT_HANDLE handle = nullptr;
+    WORD loadedPeriod = 0;
+    MWTime loadedDuration = 0;  // Zero if the loaded file is unknown
+    MWTime fileDuration = 0;
+    std::size_t samplesUsed = 0;
+    std::vector<std::uint64_t> sampleMasks;
+    std::array<WordValue, numChannels> loadedIntensity;
+};
+
+
+//
+// Process-wide store of retained connections, keyed by device identity.  Each connection is owned by
+// either the registry or a single Device, never both.  The registry is never destroyed, so
+// connections still held at exit are closed by the OS, not by a static destructor that could run
+// after MWorks (or the FTDI driver) has shut down.
+//
+class ConnectionRegistry : boost::noncopyable {
+    
+public:
+    static ConnectionRegistry& instance();
+    
+    // Hands ownership of the connection to the registry, closing any connection it already held
+    // for the same device
+    void retain(const std::string &identity, const RetainedConnection &connection);
+    
+    // Removes the connection for the given device, if any, and transfers ownership to the caller
+    bool take(const std::string &identity, RetainedConnection &connection);
+    
+private:
+    ConnectionRegistry() = default;
+    
+    static void close(const RetainedConnection &connection);
+    
+    std::mutex mutex;
+    std::map<std::string, RetainedConnection> connections;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverConnectionRegistry_hpp */
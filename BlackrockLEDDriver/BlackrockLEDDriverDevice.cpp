@@ -19,6 +19,183 @@ const std::string Device::TEMP_C("temp_c");
 const std::string Device::TEMP_D("temp_d");
 const std::string Device::TEMP_CALC("temp_calc");
 const std::string Device::SIMULATE_DEVICE("simulate_device");
+const std::string Device::SIMULATION_TIME("simulation_time");
+const std::string Device::LATENCY_TIMER("latency_timer");
+const std::string Device::USB_IN_TRANSFER_SIZE("usb_in_transfer_size");
+const std::string Device::USB_OUT_TRANSFER_SIZE("usb_out_transfer_size");
+const std::string Device::EVENT_CHAR("event_char");
+const std::string Device::CALIBRATE_LINK("calibrate_link");
+const std::string Device::CAPTURE_FILE("capture_file");
+const std::string Device::REPLAY_FILE("replay_file");
+const std::string Device::REPLAY_TIMING("replay_timing");
+const std::string Device::ACHIEVED_GAP("achieved_gap");
+const std::string Device::CALIBRATION_FILE("calibration_file");
+const std::string Device::LAYOUT_FILE("layout_file");
+const std::string Device::THERMAL_LIMIT("thermal_limit");
+const std::string Device::THERMAL_TIME_CONSTANT("thermal_time_constant");
+const std::string Device::THERMAL_GAIN("thermal_gain");
+const std::string Device::THERMAL_POLICY("thermal_policy");
+const std::string Device::THERMAL_HEADROOM("thermal_headroom");
+const std::string Device::BACKGROUND_OPEN("background_open");
+const std::string Device::DEFAULT_DURATION("default_duration");
+const std::string Device::STATUS_PAGE("status_page");
+const std::string Device::ABORT_LATENCY("abort_latency");
+const std::string Device::TRACE_FILE("trace_file");
+const std::string Device::VERIFY_DURATION("verify_duration");
+const std::string Device::MEASURED_DURATION("measured_duration");
+const std::string Device::DURATION_ERROR("duration_error");
+const std::string Device::COMPENSATE_DRIFT("compensate_drift");
+const std::string Device::DURATION_RESIDUAL("duration_residual");
+const std::string Device::TRIGGER("trigger");
+const std::string Device::TRIGGER_LATENCY("trigger_latency");
+const std::string Device::PERSISTENT_CONNECTION("persistent_connection");
+const std::string Device::TELEMETRY("telemetry");
+const std::string Device::MANIFEST("manifest");
+const std::string Device::DOSE("dose");
+const std::string Device::DOSE_LIMIT("dose_limit");
+const std::string Device::INTENSITY_INPUT("intensity_input");
+const std::string Device::COALESCE_UPDATES("coalesce_updates");
+const std::string Device::RELEASE_PADDING("release_padding");
+
+
+// Identifies the driver to FTDI and to the connection registry
+constexpr char deviceDescription[] = "Blinky 1.0";
+
+// FTDI driver defaults
+constexpr UCHAR defaultLatencyTimer = 16;  // 16 ms
+constexpr ULONG defaultTransferSize = 4096;
+
+constexpr ULONG minTransferSize = 64;
+constexpr ULONG maxTransferSize = 65536;
+
+constexpr std::size_t numCalibrationRoundTrips = 10;
+
+// When waiting for a run to end, start polling the driver this long before the expected stop time
+constexpr MWTime stopPollLeadTime = 5000;  // 5 ms
+constexpr MWTime stopPollInterval = 500;   // 0.5 ms
+
+// Longest delay, in thermal time constants, that the thermal governor will impose before a run
+constexpr MWTime maxThermalDelayTimeConstants = 10;
+
+// Resolution of the thermal governor's search for the shortest safe delay
+constexpr MWTime thermalDelayResolution = 1000;  // 1 ms
+
+// Real time for which a run on a virtual clock stays in progress, so that the action that started it
+// sees running set to true
+constexpr MWTime virtualRunCompletionDelay = 10000;  // 10 ms
+
+
+static MWTime optionalIntegerParameter(const ParameterValue &param,
+                                       const std::string &name,
+                                       MWTime minValue,
+                                       MWTime maxValue)
+{
+    if (param.empty()) {
+        return -1;
+    }
+    
+    MWTime value = param;
+    if (value < minValue || value > maxValue) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver %s must be between %d and %d") % name % minValue % maxValue).str());
+    }
+    
+    return value;
+}
+
+
+static long transferSizeParameter(const ParameterValue &param, const std::string &name) {
+    auto value = optionalIntegerParameter(param, name, minTransferSize, maxTransferSize);
+    if (value > 0 && value % minTransferSize != 0) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver %s must be a multiple of %d") % name % minTransferSize).str());
+    }
+    return value;
+}
+
+
+static MWTime thermalTimeConstantParameter(const ParameterValue &param, const std::string &name) {
+    MWTime value = param;
+    if (value <= 0) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver %s must be greater than zero") % name).str());
+    }
+    return value;
+}
+
+
+static double doseLimitParameter(const ParameterValue &param, const std::string &name) {
+    double value = param;
+    if (value <= 0.0) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver %s must be greater than zero") % name).str());
+    }
+    return value;
+}
+
+
+static double thermalGainParameter(const ParameterValue &param, const std::string &name) {
+    double value = param;
+    if (value < 0.0) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver %s must be non-negative") % name).str());
+    }
+    return value;
+}
+
+
+//
+// Finds the shortest period at which the driver can play the given duration.  Returns an empty
+// string on success, or a description of the problem if the duration is invalid.
+//
+static std::string computeQuantization(MWTime duration, WORD &period, std::size_t &samplesUsed) {
+    if (duration < minDuration || duration > maxDuration) {
+        return (boost::format("LED driver run duration must be between %g ms and %g s")
+                % (double(minDuration) / 1e3)
+                % (double(maxDuration) / 1e6)).str();
+    }
+    
+    if (duration % periodIncrement != 0) {
+        return (boost::format("LED driver run duration must be a multiple of %g ms")
+                % (double(periodIncrement) / 1e3)).str();
+    }
+    
+    const MWTime normDuration = duration / periodIncrement;
+    const MWTime normPeriodMin = MWTime(std::ceil(double(normDuration) / double(numSamples)));
+    const MWTime normPeriodMax = std::min(normDuration, maxDuration / periodIncrement);
+    
+    for (MWTime normPeriod = normPeriodMin; normPeriod <= normPeriodMax; normPeriod++) {
+        if (normDuration % normPeriod == 0) {
+            period = normPeriod;
+            samplesUsed = normDuration / normPeriod;
+            return std::string();
+        }
+    }
+    
+    return (boost::format("Requested run duration (%g ms) is not compatible with LED driver")
+            % (double(duration) / 1e3)).str();
+}
+
+
+static DeviceClock* deviceClockParameter(const ParameterValue &param, bool simulateDevice) {
+    const auto value = boost::algorithm::to_lower_copy(param.str());
+    
+    if (value == "virtual") {
+        if (!simulateDevice) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver %s can be \"virtual\" only when simulation is enabled")
+                                   % Device::SIMULATION_TIME).str());
+        }
+        return new VirtualClock();
+    }
+    
+    if (value != "real") {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("Invalid LED driver %s: \"%s\"") % Device::SIMULATION_TIME % value).str());
+    }
+    
+    return new RealTimeClock();
+}
 
 
 void Device::describeComponent(ComponentInfo &info) {
@@ -33,6 +210,43 @@ void Device::describeComponent(ComponentInfo &info) {
     info.addParameter(TEMP_D, false);
     info.addParameter(TEMP_CALC, "none");
     info.addParameter(SIMULATE_DEVICE, "NO");
+    info.addParameter(SIMULATION_TIME, "real");
+    info.addParameter(LATENCY_TIMER, false);
+    info.addParameter(USB_IN_TRANSFER_SIZE, false);
+    info.addParameter(USB_OUT_TRANSFER_SIZE, false);
+    info.addParameter(EVENT_CHAR, false);
+    info.addParameter(CALIBRATE_LINK, "NO");
+    info.addParameter(CAPTURE_FILE, false);
+    info.addParameter(REPLAY_FILE, false);
+    info.addParameter(REPLAY_TIMING, "original");
+    info.addParameter(ACHIEVED_GAP, false);
+    info.addParameter(CALIBRATION_FILE, false);
+    info.addParameter(LAYOUT_FILE, false);
+    info.addParameter(THERMAL_LIMIT, false);
+    info.addParameter(THERMAL_TIME_CONSTANT, "60000000");  // 60 s
+    info.addParameter(THERMAL_GAIN, "0.5");
+    info.addParameter(THERMAL_POLICY, "delay");
+    info.addParameter(THERMAL_HEADROOM, false);
+    info.addParameter(BACKGROUND_OPEN, "NO");
+    info.addParameter(DEFAULT_DURATION, false);
+    info.addParameter(STATUS_PAGE, false);
+    info.addParameter(ABORT_LATENCY, false);
+    info.addParameter(TRACE_FILE, false);
+    info.addParameter(VERIFY_DURATION, "NO");
+    info.addParameter(MEASURED_DURATION, false);
+    info.addParameter(DURATION_ERROR, false);
+    info.addParameter(COMPENSATE_DRIFT, "NO");
+    info.addParameter(DURATION_RESIDUAL, false);
+    info.addParameter(TRIGGER, false);
+    info.addParameter(TRIGGER_LATENCY, false);
+    info.addParameter(PERSISTENT_CONNECTION, "NO");
+    info.addParameter(TELEMETRY, false);
+    info.addParameter(MANIFEST, false);
+    info.addParameter(DOSE, false);
+    info.addParameter(DOSE_LIMIT, false);
+    info.addParameter(INTENSITY_INPUT, false);
+    info.addParameter(COALESCE_UPDATES, "NO");
+    info.addParameter(RELEASE_PADDING, "NO");
 }
 
 
@@ -44,70 +258,212 @@ Device::Device(const ParameterValueMap &parameters) :
     tempC(optionalVariable(parameters[TEMP_C])),
     tempD(optionalVariable(parameters[TEMP_D])),
     tempCalc(variableOrText(parameters[TEMP_CALC])),
+    achievedGap(optionalVariable(parameters[ACHIEVED_GAP])),
+    thermalHeadroom(optionalVariable(parameters[THERMAL_HEADROOM])),
+    abortLatency(optionalVariable(parameters[ABORT_LATENCY])),
+    measuredDuration(optionalVariable(parameters[MEASURED_DURATION])),
+    durationError(optionalVariable(parameters[DURATION_ERROR])),
+    durationResidual(optionalVariable(parameters[DURATION_RESIDUAL])),
+    trigger(optionalVariable(parameters[TRIGGER])),
+    triggerLatency(optionalVariable(parameters[TRIGGER_LATENCY])),
+    telemetry(optionalVariable(parameters[TELEMETRY])),
+    manifest(optionalVariable(parameters[MANIFEST])),
+    dose(optionalVariable(parameters[DOSE])),
     simulateDevice(parameters[SIMULATE_DEVICE]),
-    clock(Clock::instance()),
+    latencyTimer(optionalIntegerParameter(parameters[LATENCY_TIMER], LATENCY_TIMER, 1, 255)),
+    usbInTransferSize(transferSizeParameter(parameters[USB_IN_TRANSFER_SIZE], USB_IN_TRANSFER_SIZE)),
+    usbOutTransferSize(transferSizeParameter(parameters[USB_OUT_TRANSFER_SIZE], USB_OUT_TRANSFER_SIZE)),
+    eventChar(optionalIntegerParameter(parameters[EVENT_CHAR], EVENT_CHAR, 0, 255)),
+    calibrateLinkOnInit(parameters[CALIBRATE_LINK]),
+    backgroundOpen(parameters[BACKGROUND_OPEN]),
+    persistentConnection(parameters[PERSISTENT_CONNECTION]),
+    coalesceUpdates(parameters[COALESCE_UPDATES]),
+    releasePadding(parameters[RELEASE_PADDING]),
+    verifyDuration(parameters[VERIFY_DURATION]),
+    compensateDrift(parameters[COMPENSATE_DRIFT]),
+    defaultDuration(parameters[DEFAULT_DURATION].empty() ? 0 : MWTime(parameters[DEFAULT_DURATION])),
+    captureFile(parameters[CAPTURE_FILE].empty() ? "" : pathFromParameterValue(parameters[CAPTURE_FILE]).string()),
+    replayFile(parameters[REPLAY_FILE].empty() ? "" : pathFromParameterValue(parameters[REPLAY_FILE]).string()),
+    replayOriginalTiming(boost::algorithm::to_lower_copy(parameters[REPLAY_TIMING].str()) != "fast"),
+    calibration(parameters[CALIBRATION_FILE].empty() ?
+                nullptr :
+                new IntensityCalibration(pathFromParameterValue(parameters[CALIBRATION_FILE]).string())),
+    layout(parameters[LAYOUT_FILE].empty() ?
+           nullptr :
+           new ChannelLayout(pathFromParameterValue(parameters[LAYOUT_FILE]).string())),
+    thermalLimit(parameters[THERMAL_LIMIT].empty() ? 0.0 : double(parameters[THERMAL_LIMIT])),
+    doseLimit(parameters[DOSE_LIMIT].empty() ? 0.0 : doseLimitParameter(parameters[DOSE_LIMIT], DOSE_LIMIT)),
+    thermalRejectOnly(boost::algorithm::to_lower_copy(parameters[THERMAL_POLICY].str()) == "reject"),
+    thermalModel(parameters[THERMAL_LIMIT].empty() ?
+                 nullptr :
+                 new ThermalModel(thermalTimeConstantParameter(parameters[THERMAL_TIME_CONSTANT], THERMAL_TIME_CONSTANT),
+                                  thermalGainParameter(parameters[THERMAL_GAIN], THERMAL_GAIN))),
+    statusPage(parameters[STATUS_PAGE].empty() ? nullptr : new StatusPage(parameters[STATUS_PAGE].str())),
+    intensityInput(parameters[INTENSITY_INPUT].empty() ?
+                   nullptr :
+                   new IntensityInput(parameters[INTENSITY_INPUT].str())),
+    clock(deviceClockParameter(parameters[SIMULATION_TIME], simulateDevice)),
+    trace(parameters[TRACE_FILE].empty() ? nullptr : new TraceRecorder(parameters[TRACE_FILE].str(), *clock)),
     handle(nullptr),
+    loadedPeriod(0),
+    loadedSamplesUsed(0),
+    abortEpoch(0),
     intensityChanged(true),
     filePlaying(false),
     lastRunDuration(0),
-    simulatedRunStartTime(0)
+    fileDuration(0),
+    exposureDuration(0),
+    releasingPadding(false),
+    runStartTime(0),
+    lastPlayingTime(0),
+    lastStopTime(0),
+    runQueueGeneration(0),
+    runQueueShutdown(false),
+    triggerPending(false),
+    pendingTriggerTime(0),
+    pendingTriggerEpoch(0),
+    triggerShutdown(false),
+    uploadPending(false),
+    uploadInProgress(false),
+    deferAbortAcks(false),
+    uploadShutdown(false),
+    updatesSubmitted(0),
+    updatesCoalesced(0),
+    updatesDelivered(0)
 {
     intensity.fill(WordValue::zero());
+    loadedIntensity.fill(WordValue::zero());
+    deliveredDose.fill(0.0);
+    requestedPower.fill(0.0);
+    powerControlled.fill(false);
+    inputControlled.fill(false);
+    
+    if (compensateDrift && !verifyDuration) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("LED driver %s requires %s") % COMPENSATE_DRIFT % VERIFY_DURATION).str());
+    }
+    
+    if (defaultDuration > 0) {
+        stageDuration(defaultDuration);
+    }
 }
 
 
 Device::~Device() {
-    lock_guard lock(mutex);
+    if (openThread.joinable()) {
+        openThread.join();
+    }
+    
+    if (runQueueThread.joinable()) {
+        {
+            lock_guard queueLock(runQueueMutex);
+            runQueueShutdown = true;
+        }
+        runQueueCondition.notify_all();
+        runQueueThread.join();
+    }
+    
+    if (triggerNotification) {
+        triggerNotification->remove();
+    }
+    if (triggerThread.joinable()) {
+        {
+            lock_guard triggerLock(triggerMutex);
+            triggerShutdown = true;
+        }
+        triggerCondition.notify_all();
+        triggerThread.join();
+    }
+    
+    if (uploadThread.joinable()) {
+        {
+            auto lock = lockDevice();
+            uploadShutdown = true;
+        }
+        uploadCondition.notify_all();
+        uploadThread.join();
+    }
+    
+    auto lock = lockDevice();
     
     if (checkStatusTask) {
         checkStatusTask->cancel();
     }
+    if (stopPollTask) {
+        stopPollTask->cancel();
+    }
+    if (releaseTask) {
+        releaseTask->cancel();
+    }
     
-    if (handle || simulateDevice) {
-        stopFilePlaying();
+    bool fileStopped = true;
+    if (transport || simulateDevice) {
+        fileStopped = stopFilePlaying();
     }
     
-    if (handle) {
-        FT_STATUS status = FT_Close(handle);
-        if (FT_OK != status) {
-            merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot close LED driver (status: %d)", status);
+    if (handle && persistentConnection && fileStopped) {
+        // Leave the connection open for the next experiment
+        {
+            lock_guard transportLock(transportMutex);
+            transport.reset();
         }
+        
+        RetainedConnection retained;
+        retained.handle = handle;
+        retained.loadedPeriod = loadedPeriod;
+        retained.loadedDuration = lastRunDuration;
+        retained.fileDuration = fileDuration;
+        retained.samplesUsed = loadedSamplesUsed;
+        retained.sampleMasks = loadedSampleMasks;
+        retained.loadedIntensity = loadedIntensity;
+        ConnectionRegistry::instance().retain(deviceDescription, retained);
+        
+        handle = nullptr;
+    } else {
+        closeHandle();
     }
 }
 
 
 bool Device::initialize() {
-    lock_guard lock(mutex);
-    
-    if (simulateDevice) {
-        mwarning(M_IODEVICE_MESSAGE_DOMAIN, "LED driver simulation is enabled");
-    } else {
-        FT_STATUS status;
-        
-        if (FT_OK != (status = FT_OpenEx(const_cast<char *>("Blinky 1.0"), FT_OPEN_BY_DESCRIPTION, &handle))) {
-            switch (status) {
-                case FT_DEVICE_NOT_FOUND:
-                    merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver was not found. Is the USB cable connected?");
-                    break;
-                    
-                case FT_DEVICE_NOT_OPENED:
-                    merror(M_IODEVICE_MESSAGE_DOMAIN,
-                           "LED driver was found but could not be opened. This is probably due to a conflict "
-                           "with a system device driver. To resolve this issue, open the Terminal application "
-                           "and execute the following command:\n\n\t"
-                           "sudo kextunload -b com.apple.driver.AppleUSBFTDI\n");
-                    break;
-                    
-                default:
-                    merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot open LED driver (status: %d)", status);
-                    break;
+    if (backgroundOpen) {
+        // Don't return until the open thread holds the device mutex, so that every other use of the
+        // device waits for the connection to complete
+        std::promise<void> openStarted;
+        auto openStartedFuture = openStarted.get_future();
+        
+        openThread = std::thread([this, openStarted = std::move(openStarted)]() mutable {
+            auto lock = lockDevice();
+            openStarted.set_value();
+            
+            const MWTime startTime = clock->getCurrentTimeUS();
+            bool connected = false;
+            
+            // Nothing can catch an exception thrown on this thread (e.g. by a capture or replay
+            // transport that can't open its file), so report it here
+            try {
+                connected = connect();
+            } catch (const std::exception &e) {
+                merror(M_IODEVICE_MESSAGE_DOMAIN, "%s", e.what());
             }
-            return false;
-        }
+            
+            if (connected) {
+                mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+                        "LED driver connected in background (%g ms)",
+                        double(clock->getCurrentTimeUS() - startTime) / 1e3);
+            } else {
+                merror(M_IODEVICE_MESSAGE_DOMAIN, "Background connection to LED driver failed");
+                {
+                    lock_guard transportLock(transportMutex);
+                    transport.reset();
+                }
+            }
+        });
         
-        // Set read timeout to 2s, write timeout to 1s
-        if (FT_OK != (status = FT_SetTimeouts(handle, 2000, 1000))) {
-            merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot set LED driver I/O timeouts (status: %d)", status);
+        openStartedFuture.wait();
+    } else {
+        auto lock = lockDevice();
+        if (!connect()) {
             return false;
         }
     }
@@ -119,7 +475,8 @@ bool Device::initialize() {
                                                         M_REPEAT_INDEFINITELY,
                                                         [weakThis]() {
                                                             if (auto sharedThis = weakThis.lock()) {
-                                                                lock_guard lock(sharedThis->mutex);
+                                                                TraceSpan span(sharedThis->trace.get(), "status poll", "poll");
+                                                                auto lock = sharedThis->lockDevice();
                                                                 sharedThis->checkIfFileStopped();
                                                             }
                                                             return nullptr;
@@ -129,111 +486,1225 @@ bool Device::initialize() {
                                                         M_DEFAULT_IODEVICE_FAIL_SLOP_US,
                                                         M_MISSED_EXECUTION_DROP);
     
+    runQueueThread = std::thread([this]() { runQueueLoop(); });
+    
+    if (coalesceUpdates) {
+        uploadThread = std::thread([this]() { uploadLoop(); });
+    }
+    
+    if (trigger) {
+        triggerThread = std::thread([this]() { triggerLoop(); });
+        auto callback = [weakThis](const Datum &value, MWTime time) {
+            if (value.getBool()) {
+                if (auto sharedThis = weakThis.lock()) {
+                    sharedThis->fireTrigger(time);
+                }
+            }
+        };
+        triggerNotification = boost::make_shared<VariableCallbackNotification>(callback);
+        trigger->addNotification(triggerNotification);
+    }
+    
     return true;
 }
 
 
 bool Device::stopDeviceIO() {
-    lock_guard lock(mutex);
+    clearRunQueue();
+    
+    auto lock = lockDevice();
     stopFilePlaying();
+    
+    // The next data file should be able to interpret every manifest on its own
+    manifestEncoder.reset();
+    
+    if (verifyDuration && durationErrorStats.count > 0) {
+        mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+                "LED driver run duration error over %lu runs: mean %g ms, SD %g ms, range %g to %g ms",
+                durationErrorStats.count,
+                durationErrorStats.mean / 1e3,
+                durationErrorStats.standardDeviation() / 1e3,
+                durationErrorStats.min / 1e3,
+                durationErrorStats.max / 1e3);
+        if (driftEstimator.isReady()) {
+            mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+                    "LED driver clock rate relative to MWorks clock: %+.1f ppm",
+                    (driftEstimator.getRatio() - 1.0) * 1e6);
+        } else {
+            mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+                    "LED driver clock rate could not be estimated (runs of more varied durations are needed)");
+        }
+    }
+    
+    if (coalesceUpdates && updatesSubmitted > 0) {
+        mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+                "LED driver intensity updates: %llu submitted, %llu coalesced, %llu uploaded",
+                updatesSubmitted,
+                updatesCoalesced,
+                updatesDelivered);
+    }
+    
+    // Writing the trace can take a while, so don't hold up other users of the device
+    lock.unlock();
+    if (trace) {
+        trace->write();
+    }
+    
     return true;
 }
 
 
 void Device::setIntensity(const std::set<int> &channels, double value) {
-    lock_guard lock(mutex);
+    TraceSpan span(trace.get(), "setIntensity", "action");
+    
+    // Never waits for a background upload
+    auto lock = lockState();
     
     if (value < 0.0 || value > 1.0) {
         merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver channel intensity must be between 0 and 1");
         return;
     }
     
-    WORD wordValue = std::round(value * double(std::numeric_limits<WORD>::max()));
+    WORD wordValue = std::round(value * double(std::numeric_limits<WORD>::max()));
+    
+    for (int channelNum : channels) {
+        if ((channelNum < 1) || (channelNum > intensity.size())) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "Invalid LED driver channel number: %d", channelNum);
+        } else {
+            intensity[channelNum - 1] = wordValue;
+            powerControlled[channelNum - 1] = false;
+        }
+    }
+    
+    intensityChanged = true;
+    submitIntensityUpdate();
+}
+
+
+void Device::setPower(const std::set<int> &channels, double power) {
+    TraceSpan span(trace.get(), "setPower", "action");
+    
+    // Never waits for a background upload
+    auto lock = lockState();
+    
+    if (!calibration) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver channel power cannot be set without a calibration file");
+        return;
+    }
+    
+    if (power < 0.0) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver channel power must be non-negative");
+        return;
+    }
+    
+    for (int channelNum : channels) {
+        if ((channelNum < 1) || (std::size_t(channelNum) > intensity.size())) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "Invalid LED driver channel number: %d", channelNum);
+        } else if (!calibration->isCalibrated(channelNum - 1)) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver channel %d is not calibrated", channelNum);
+        } else if (power > calibration->getMaxPower(channelNum - 1)) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN,
+                   "Requested power (%g) exceeds calibrated maximum (%g) for LED driver channel %d",
+                   power,
+                   calibration->getMaxPower(channelNum - 1),
+                   channelNum);
+        } else {
+            requestedPower[channelNum - 1] = power;
+            powerControlled[channelNum - 1] = true;
+        }
+    }
+    
+    // Recompute the drive words for all power-controlled channels at once
+    calibration->apply(requestedPower, powerControlled, intensity);
+    
+    intensityChanged = true;
+    submitIntensityUpdate();
+}
+
+
+void Device::setPattern(const PatternSpec &spec) {
+    TraceSpan span(trace.get(), "setPattern", "action");
+    
+    // Never waits for a background upload
+    auto lock = lockState();
+    
+    if (!layout) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver pattern cannot be set without a layout file");
+        return;
+    }
+    
+    const auto errorMessage = layout->rasterize(spec, intensity);
+    if (!errorMessage.empty()) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "%s", errorMessage.c_str());
+        return;
+    }
+    
+    const auto &mask = layout->getMask();
+    for (std::size_t i = 0; i < numChannels; i++) {
+        if (mask[i]) {
+            powerControlled[i] = false;
+        }
+    }
+    
+    intensityChanged = true;
+    submitIntensityUpdate();
+}
+
+
+void Device::stageDuration(MWTime duration) {
+    auto lock = lockDevice();
+    
+    if (stagedDurations.count(duration)) {
+        return;
+    }
+    
+    StagedDuration staged;
+    const auto errorMessage = computeQuantization(duration, staged.period, staged.samplesUsed);
+    if (!errorMessage.empty()) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, errorMessage);
+    }
+    
+    stagedDurations.emplace(duration, staged);
+}
+
+
+void Device::prepare(MWTime duration) {
+    TraceSpan span(trace.get(), "prepare", "action");
+    
+    auto lock = lockDevice();
+    updateFile(duration);
+}
+
+
+void Device::run(MWTime duration) {
+    TraceSpan span(trace.get(), "run", "action");
+    
+    const std::uint64_t epoch = abortEpoch;
+    QueuedRun delayedRun;
+    
+    {
+        auto lock = lockDevice();
+        
+        if (!updateFile(duration)) {
+            return;
+        }
+        
+        if (!(thermalModel &&
+              !thermalRejectOnly &&
+              predictThermalHeadroom(clock->getCurrentTimeUS(), duration) < 0.0))
+        {
+            MWTime thermalDelay;
+            if (checkThermalBudget(duration, thermalDelay)) {
+                startFilePlaying(epoch);
+            }
+            return;
+        }
+        
+        // The array must cool first.  Rather than block the calling thread, hand the run to the run
+        // queue, which waits out the delay (or rejects the run) and then starts it.  Stopping or
+        // aborting the driver cancels it.
+        delayedRun.intensity = intensity;
+        delayedRun.duration = duration;
+        delayedRun.gap = 0;
+        delayedRun.queueTime = clock->getCurrentTimeUS();
+    }
+    
+    {
+        lock_guard queueLock(runQueueMutex);
+        runQueue.push_back(delayedRun);
+    }
+    runQueueCondition.notify_all();
+}
+
+
+void Device::queueRun(MWTime duration, MWTime gap) {
+    TraceSpan span(trace.get(), "queueRun", "action");
+    
+    if (gap < 0) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver inter-run gap must be non-negative");
+        return;
+    }
+    
+    QueuedRun queuedRun;
+    
+    {
+        auto lock = lockDevice();
+        
+        // Reject invalid durations now, rather than when the run is dequeued
+        WORD period;
+        std::size_t samplesUsed;
+        if (!quantizeDuration(duration, period, samplesUsed)) {
+            return;
+        }
+        
+        queuedRun.intensity = intensity;
+        queuedRun.duration = duration;
+        queuedRun.gap = gap;
+        queuedRun.queueTime = clock->getCurrentTimeUS();
+    }
+    
+    {
+        lock_guard queueLock(runQueueMutex);
+        runQueue.push_back(queuedRun);
+    }
+    runQueueCondition.notify_all();
+}
+
+
+bool Device::runPulseTrain(const PulseTrainSpec &spec, MWTime &timingError) {
+    TraceSpan span(trace.get(), "runPulseTrain", "action");
+    
+    PulseTrainEncoding encoding;
+    const auto errorMessage = compilePulseTrain(spec, encoding);
+    if (!errorMessage.empty()) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "%s", errorMessage.c_str());
+        return false;
+    }
+    
+    const std::uint64_t epoch = abortEpoch;
+    timingError = encoding.maxTimingError;
+    if (encoding.maxTimingError > 0) {
+        mwarning(M_IODEVICE_MESSAGE_DOMAIN,
+                 "LED driver pulse train edges differ from requested times by up to %g ms",
+                 double(encoding.maxTimingError) / 1e3);
+    }
+    
+    auto lock = lockDevice();
+    
+    if (!checkIfFileStopped()) {
+        return false;
+    }
+    
+    if (filePlaying) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver is already running");
+        return false;
+    }
+    
+    readIntensityInput();
+    
+    const MWTime samplePeriod = MWTime(encoding.period) * periodIncrement;
+    const MWTime trainDuration = MWTime(encoding.samplesUsed) * samplePeriod;
+    
+    // The thermal model treats the train as continuous exposure, which is conservative
+    if (!checkThermalLimit(trainDuration)) {
+        return false;
+    }
+    
+    // The file will no longer hold a constant-intensity run
+    lastRunDuration = 0;
+    
+    if (!((encoding.period == loadedPeriod || setFileTimePeriod(encoding.period)) &&
+          loadPulseTrain(encoding)))
+    {
+        return false;
+    }
+    
+    loadedIntensity = intensity;
+    exposureDuration = trainDuration;
+    fileDuration = (simulateDevice ? trainDuration : MWTime(numSamples) * samplePeriod);
+    loadedSamplesUsed = encoding.samplesUsed;
+    loadedSampleMasks.assign(encoding.samplesUsed, 0);
+    for (std::size_t i = 0; i < encoding.samplesUsed; i++) {
+        for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+            if (encoding.on[i][channelIndex] && WORD(intensity[channelIndex])) {
+                loadedSampleMasks[i] |= std::uint64_t(1) << channelIndex;
+            }
+        }
+    }
+    
+    updateStatus([&](StatusPage::Layout &status) {
+        std::copy(intensity.begin(), intensity.end(), status.intensity.begin());
+        status.samplePeriod = samplePeriod;
+        status.samplesUsed = encoding.samplesUsed;
+    });
+    
+    return startFilePlaying(epoch);
+}
+
+
+void Device::stop() {
+    TraceSpan span(trace.get(), "stop", "action");
+    
+    clearRunQueue();
+    
+    auto lock = lockDevice();
+    stopFilePlaying();
+}
+
+
+void Device::abort() {
+    TraceSpan span(trace.get(), "abort", "action");
+    
+    clearRunQueue();
+    
+    if (simulateDevice) {
+        {
+            lock_guard transportLock(transportMutex);
+            abortEpoch++;
+        }
+        auto lock = lockDevice();
+        stopFilePlaying();
+        return;
+    }
+    
+    {
+        // Don't wait for the device mutex.  Holding the transport mutex guarantees only that no
+        // other thread is part way through writing a request.  Since a request can't be interrupted
+        // part way through, the worst case is waiting for the rest of an LED program upload (about
+        // 6.4 KB) to be written.
+        lock_guard transportLock(transportMutex);
+        
+        // Any run that was about to start must not start after the stop
+        abortEpoch++;
+        
+        if (!transport) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver is not connected");
+            return;
+        }
+        
+        StopFilePlayingRequest request;
+        const MWTime sendTime = clock->getCurrentTimeUS();
+        TraceSpan writeSpan(trace.get(), StopFilePlayingCommand::name(), "write");
+        if (!request.write(*transport)) {
+            return;
+        }
+        pendingAborts.push_back(sendTime);
+    }
+    
+    // Read the acknowledgement once any in-flight command has completed
+    boost::weak_ptr<Device> weakThis(component_shared_from_this<Device>());
+    Scheduler::instance()->scheduleUS(FILELINE,
+                                      0,
+                                      0,
+                                      1,
+                                      [weakThis]() {
+                                          if (auto sharedThis = weakThis.lock()) {
+                                              auto lock = sharedThis->lockDevice();
+                                              sharedThis->finishAborts();
+                                          }
+                                          return nullptr;
+                                      },
+                                      M_DEFAULT_IODEVICE_PRIORITY,
+                                      M_DEFAULT_IODEVICE_WARN_SLOP_US,
+                                      M_DEFAULT_IODEVICE_FAIL_SLOP_US,
+                                      M_MISSED_EXECUTION_DROP);
+}
+
+
+static double convertTemp(WORD rawValue, double pullup) {
+    auto value = double(rawValue);
+    
+    if (pullup == 0.0) {
+        // For compatibility with old firmware that pre-calculated temperature and sent it
+        // in millidegrees Celsius
+        value /= 1000.0;
+    } else {
+        // Calculate resistance value of thermistor in kΩ with a voltage divider with the
+        // specified pullup resistance
+        value = pullup / ((double(0xFFFF) / value) - 1.0);
+        
+        // Calculate temperature in Celsius (linear fit)
+        value = -4.4617 * value + 66.0;
+    }
+    
+    return value;
+}
+
+
+void Device::readTemps() {
+    TraceSpan span(trace.get(), "readTemps", "action");
+    
+    auto lock = lockDevice();
+    
+    auto currentTempCalc = tempCalc->getValue().getString();
+    boost::algorithm::to_lower(currentTempCalc);
+    double pullup = 0.0;
+    
+    if (currentTempCalc == "5k") {
+        pullup = 5.0;
+    } else if (currentTempCalc == "10k") {
+        pullup = 10.0;
+    } else if (currentTempCalc != "none") {
+        merror(M_IODEVICE_MESSAGE_DOMAIN,
+               "LED driver temperature calculation type (\"%s\") is invalid; using \"none\" instead",
+               currentTempCalc.c_str());
+    }
+    
+    if (!simulateDevice) {
+        ThermistorValuesRequest request;
+        ThermistorValuesResponse response;
+        
+        if (!perform(request, response)) {
+            return;
+        }
+        const MWTime readTime = clock->getCurrentTimeUS();
+        
+        const std::array<WORD, ThermalModel::numBanks> rawValues = {{
+            response.getBody().tempA,
+            response.getBody().tempB,
+            response.getBody().tempC,
+            response.getBody().tempD
+        }};
+        const std::array<VariablePtr, ThermalModel::numBanks> vars = {{ tempA, tempB, tempC, tempD }};
+        std::array<double, ThermalModel::numBanks> temps;
+        
+        for (std::size_t i = 0; i < ThermalModel::numBanks; i++) {
+            temps[i] = convertTemp(rawValues[i], pullup);
+            if (vars[i]) {
+                vars[i]->setValue(temps[i]);
+            }
+            if (thermalModel) {
+                thermalModel->addReading(i, temps[i], readTime);
+            }
+        }
+        
+        if (telemetry) {
+            announceTelemetry(readTime, rawValues, temps);
+        }
+        
+        updateStatus([&](StatusPage::Layout &status) {
+            std::copy(temps.begin(), temps.end(), status.temps.begin());
+        });
+    }
+}
+
+
+void Device::announceTelemetry(MWTime readTime,
+                               const std::array<WORD, ThermalModel::numBanks> &rawValues,
+                               const std::array<double, ThermalModel::numBanks> &temps)
+{
+    Datum::list_value_type rawList, tempList;
+    for (std::size_t i = 0; i < ThermalModel::numBanks; i++) {
+        rawList.emplace_back(long(rawValues[i]));
+        tempList.emplace_back(temps[i]);
+    }
+    
+    Datum::dict_value_type values;
+    values.emplace(Datum("time"), Datum(readTime));
+    values.emplace(Datum("raw"), Datum(rawList));
+    values.emplace(Datum("temps"), Datum(tempList));
+    values.emplace(Datum("running"), Datum(filePlaying));
+    
+    // One event per reading, timestamped when the reading was taken
+    telemetry->setValue(Datum(values), readTime);
+}
+
+
+bool Device::connect() {
+    if (simulateDevice) {
+        mwarning(M_IODEVICE_MESSAGE_DOMAIN, "LED driver simulation is enabled");
+    } else if (!replayFile.empty()) {
+        mwarning(M_IODEVICE_MESSAGE_DOMAIN, "LED driver I/O will be replayed from a capture file");
+        {
+            lock_guard transportLock(transportMutex);
+            transport.reset(new ReplayTransport(replayFile, replayOriginalTiming));
+        }
+    } else {
+        RetainedConnection retained;
+        if (persistentConnection && ConnectionRegistry::instance().take(deviceDescription, retained)) {
+            if (adoptConnection(retained)) {
+                mprintf(M_IODEVICE_MESSAGE_DOMAIN, "Reusing existing LED driver connection");
+            } else {
+                mwarning(M_IODEVICE_MESSAGE_DOMAIN, "Existing LED driver connection is no longer usable; reopening");
+                closeHandle();
+            }
+        }
+        
+        if (!handle && !openHandle()) {
+            return false;
+        }
+        
+        if (!configureLink()) {
+            return false;
+        }
+    }
+    
+    if (transport && !captureFile.empty()) {
+        {
+            lock_guard transportLock(transportMutex);
+            transport.reset(new CaptureTransport(std::move(transport), captureFile));
+        }
+    }
+    
+    // Upload a default program, so that a first run with the default duration needs only new
+    // intensities
+    if (defaultDuration > 0 && !updateFile(defaultDuration)) {
+        return false;
+    }
+    
+    return true;
+}
+
+
+bool Device::openHandle() {
+    FT_STATUS status;
+    
+    if (FT_OK != (status = FT_OpenEx(const_cast<char *>(deviceDescription), FT_OPEN_BY_DESCRIPTION, &handle))) {
+        switch (status) {
+            case FT_DEVICE_NOT_FOUND:
+                merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver was not found. Is the USB cable connected?");
+                break;
+                
+            case FT_DEVICE_NOT_OPENED:
+                merror(M_IODEVICE_MESSAGE_DOMAIN,
+                       "LED driver was found but could not be opened. This is probably due to a conflict "
+                       "with a system device driver. To resolve this issue, open the Terminal application "
+                       "and execute the following command:\n\n\t"
+                       "sudo kextunload -b com.apple.driver.AppleUSBFTDI\n");
+                break;
+                
+            default:
+                merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot open LED driver (status: %d)", status);
+                break;
+        }
+        return false;
+    }
+    
+    // Set read timeout to 2s, write timeout to 1s
+    if (FT_OK != (status = FT_SetTimeouts(handle, 2000, 1000))) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot set LED driver I/O timeouts (status: %d)", status);
+        return false;
+    }
+    
+    {
+        lock_guard transportLock(transportMutex);
+        transport.reset(new FTDITransport(handle));
+    }
+    
+    return true;
+}
+
+
+bool Device::adoptConnection(const RetainedConnection &retained) {
+    handle = retained.handle;
+    {
+        lock_guard transportLock(transportMutex);
+        transport.reset(new FTDITransport(handle));
+    }
+    
+    // Make sure the driver is still there, and that nothing is playing
+    transport->purge();
+    IsFilePlayingRequest request;
+    IsFilePlayingResponse response;
+    if (!perform(request, response) || response.getBody().filePlaying) {
+        return false;
+    }
+    
+    loadedPeriod = retained.loadedPeriod;
+    if (retained.loadedDuration > 0) {
+        lastRunDuration = retained.loadedDuration;
+        fileDuration = retained.fileDuration;
+        exposureDuration = retained.loadedDuration;
+        loadedSamplesUsed = retained.samplesUsed;
+        loadedSampleMasks = retained.sampleMasks;
+        loadedIntensity = retained.loadedIntensity;
+    }
+    
+    return true;
+}
+
+
+void Device::closeHandle() {
+    // Destroy the transport (flushing any capture file) before closing the handle it uses
+    {
+        lock_guard transportLock(transportMutex);
+        transport.reset();
+    }
+    
+    if (handle) {
+        FT_STATUS status = FT_Close(handle);
+        if (FT_OK != status) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot close LED driver (status: %d)", status);
+        }
+        handle = nullptr;
+    }
+    
+    loadedPeriod = 0;
+    lastRunDuration = 0;
+}
+
+
+bool Device::configureLink() {
+    if (eventChar >= 0) {
+        FT_STATUS status = FT_SetChars(handle, UCHAR(eventChar), 1, 0, 0);
+        if (FT_OK != status) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot set LED driver event character (status: %d)", status);
+            return false;
+        }
+    }
+    
+    LinkProfile profile {
+        UCHAR((latencyTimer > 0) ? latencyTimer : defaultLatencyTimer),
+        ULONG((usbInTransferSize > 0) ? usbInTransferSize : defaultTransferSize),
+        ULONG((usbOutTransferSize > 0) ? usbOutTransferSize : defaultTransferSize)
+    };
+    
+    if (calibrateLinkOnInit && !calibrateLink(profile)) {
+        return false;
+    }
+    
+    return applyLinkProfile(profile);
+}
+
+
+bool Device::applyLinkProfile(const LinkProfile &profile) {
+    FT_STATUS status;
+    
+    if (FT_OK != (status = FT_SetLatencyTimer(handle, profile.latencyTimer))) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot set LED driver latency timer (status: %d)", status);
+        return false;
+    }
+    
+    if (FT_OK != (status = FT_SetUSBParameters(handle, profile.inTransferSize, profile.outTransferSize))) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot set LED driver USB transfer sizes (status: %d)", status);
+        return false;
+    }
+    
+    return true;
+}
+
+
+bool Device::calibrateLink(LinkProfile &profile) {
+    // Sweep only the settings that weren't specified explicitly
+    std::vector<UCHAR> latencyTimers { 1, 2, 4, 8, 16 };
+    if (latencyTimer > 0) {
+        latencyTimers.assign(1, profile.latencyTimer);
+    }
+    
+    std::vector<ULONG> transferSizes { 64, 512, 4096, 65536 };
+    if (usbInTransferSize > 0 && usbOutTransferSize > 0) {
+        transferSizes.assign(1, 0);
+    }
+    
+    bool haveBest = false;
+    LinkProfile bestProfile = profile;
+    MWTime bestRoundTripTime = 0;
+    MWTime bestLoadFileTime = 0;
+    
+    for (auto candidateLatencyTimer : latencyTimers) {
+        for (auto candidateTransferSize : transferSizes) {
+            const LinkProfile candidate {
+                candidateLatencyTimer,
+                (usbInTransferSize > 0) ? profile.inTransferSize : candidateTransferSize,
+                (usbOutTransferSize > 0) ? profile.outTransferSize : candidateTransferSize
+            };
+            
+            MWTime roundTripTime, loadFileTime;
+            if (!measureLinkProfile(candidate, roundTripTime, loadFileTime)) {
+                return false;
+            }
+            
+#ifdef MW_BLACKROCK_LEDDRIVER_DEBUG
+            mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+                    "Link profile %d ms, %lu/%lu bytes: round trip %g ms, LoadFile %g ms",
+                    int(candidate.latencyTimer),
+                    candidate.inTransferSize,
+                    candidate.outTransferSize,
+                    double(roundTripTime) / 1e3,
+                    double(loadFileTime) / 1e3);
+#endif
+            
+            if (!haveBest || (roundTripTime + loadFileTime < bestRoundTripTime + bestLoadFileTime)) {
+                haveBest = true;
+                bestProfile = candidate;
+                bestRoundTripTime = roundTripTime;
+                bestLoadFileTime = loadFileTime;
+            }
+        }
+    }
+    
+    profile = bestProfile;
+    
+    // Calibration overwrote the loaded file, so the next run must upload a new one
+    intensityChanged = true;
+    lastRunDuration = 0;
+    
+    mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+            "LED driver link calibration selected latency timer = %d ms, USB transfer sizes = %lu/%lu bytes "
+            "(IsFilePlaying round trip: %g ms, LoadFile: %g ms)",
+            int(profile.latencyTimer),
+            profile.inTransferSize,
+            profile.outTransferSize,
+            double(bestRoundTripTime) / 1e3,
+            double(bestLoadFileTime) / 1e3);
+    
+    return true;
+}
+
+
+bool Device::measureLinkProfile(const LinkProfile &profile, MWTime &roundTripTime, MWTime &loadFileTime) {
+    if (!applyLinkProfile(profile)) {
+        return false;
+    }
+    
+    std::array<MWTime, numCalibrationRoundTrips> roundTripTimes;
+    
+    for (auto &time : roundTripTimes) {
+        IsFilePlayingRequest request;
+        IsFilePlayingResponse response;
+        
+        const MWTime before = clock->getCurrentTimeUS();
+        if (!perform(request, response)) {
+            return false;
+        }
+        time = clock->getCurrentTimeUS() - before;
+    }
+    
+    // Use the median, so that a single slow transfer doesn't skew the result
+    std::nth_element(roundTripTimes.begin(), roundTripTimes.begin() + roundTripTimes.size() / 2, roundTripTimes.end());
+    roundTripTime = roundTripTimes[roundTripTimes.size() / 2];
+    
+    const MWTime before = clock->getCurrentTimeUS();
+    if (!loadFile(intensity, 0)) {
+        return false;
+    }
+    loadFileTime = clock->getCurrentTimeUS() - before;
+    
+    return true;
+}
+
+
+void Device::runQueueLoop() {
+    unique_lock queueLock(runQueueMutex);
+    
+    while (true) {
+        runQueueCondition.wait(queueLock, [this]() { return runQueueShutdown || !runQueue.empty(); });
+        if (runQueueShutdown) {
+            return;
+        }
+        
+        const QueuedRun queuedRun = runQueue.front();
+        runQueue.pop_front();
+        const std::uint64_t generation = runQueueGeneration;
+        
+        queueLock.unlock();
+        if (!performQueuedRun(queuedRun, generation)) {
+            // Don't attempt the remaining runs if this one failed or was cancelled
+            clearRunQueue();
+        }
+        queueLock.lock();
+    }
+}
+
+
+bool Device::performQueuedRun(const QueuedRun &queuedRun, std::uint64_t generation) {
+    const std::uint64_t epoch = abortEpoch;
+    if (!waitForFileStopped(generation)) {
+        return false;
+    }
+    
+    // Upload the next file as soon as the previous one has stopped
+    MWTime previousStopTime;
+    MWTime startTime = 0;
+    {
+        auto lock = lockDevice();
+        
+        if (generation != runQueueGeneration) {
+            return false;
+        }
+        
+        // Upload the intensities captured when the run was queued, but leave the live intensities
+        // (and the power settings derived from them) as they are for later actions.  Channels set by
+        // the intensity input take its latest values in both.
+        readIntensityInput();
+        const auto liveIntensity = intensity;
+        for (std::size_t i = 0; i < numChannels; i++) {
+            if (!inputControlled[i]) {
+                intensity[i] = queuedRun.intensity[i];
+            }
+        }
+        intensityChanged = true;
+        
+        MWTime thermalDelay;
+        const bool ready = (updateFile(queuedRun.duration) && checkThermalBudget(queuedRun.duration, thermalDelay));
+        
+        for (std::size_t i = 0; i < numChannels; i++) {
+            if (!inputControlled[i]) {
+                intensity[i] = liveIntensity[i];
+            }
+        }
+        intensityChanged = (intensity != loadedIntensity);
+        
+        if (!ready) {
+            return false;
+        }
+        
+        previousStopTime = lastStopTime;
+        if (previousStopTime > 0) {
+            startTime = previousStopTime + queuedRun.gap;
+        }
+        if (thermalDelay > 0) {
+            startTime = std::max(startTime, clock->getCurrentTimeUS() + thermalDelay);
+        }
+    }
+    
+    if (startTime > 0 && !waitForRunQueue(startTime, generation)) {
+        return false;
+    }
+    
+    auto lock = lockDevice();
+    
+    if (generation != runQueueGeneration || !startFilePlaying(epoch)) {
+        return false;
+    }
+    
+    // If the driver was already idle when the run was queued, there was no previous run to follow
+    if (previousStopTime >= queuedRun.queueTime && achievedGap) {
+        achievedGap->setValue(runStartTime - previousStopTime);
+    }
+    
+    return true;
+}
+
+
+bool Device::waitForFileStopped(std::uint64_t generation) {
+    while (true) {
+        MWTime wakeTime;
+        
+        {
+            auto lock = lockDevice();
+            
+            if (!checkIfFileStopped()) {
+                return false;
+            }
+            if (!filePlaying) {
+                return true;
+            }
+            
+            // Sleep until shortly before the expected stop time, then poll at a high rate
+            wakeTime = std::max(expectedStopTime() - stopPollLeadTime,
+                                clock->getCurrentTimeUS() + stopPollInterval);
+        }
+        
+        if (!waitForRunQueue(wakeTime, generation)) {
+            return false;
+        }
+    }
+}
+
+
+bool Device::waitForRunQueue(MWTime targetTime, std::uint64_t generation) {
+    unique_lock queueLock(runQueueMutex);
+    
+    if (clock->isVirtual()) {
+        // Skip straight to the target time
+        if (runQueueShutdown || generation != runQueueGeneration) {
+            return false;
+        }
+        clock->advanceTo(targetTime);
+        return true;
+    }
+    
+    while (!runQueueShutdown && generation == runQueueGeneration) {
+        const MWTime remainingTime = targetTime - clock->getCurrentTimeUS();
+        if (remainingTime <= 0) {
+            return true;
+        }
+        runQueueCondition.wait_for(queueLock, std::chrono::microseconds(remainingTime));
+    }
+    
+    return false;
+}
+
+
+void Device::clearRunQueue() {
+    {
+        lock_guard queueLock(runQueueMutex);
+        runQueue.clear();
+        runQueueGeneration++;
+    }
+    runQueueCondition.notify_all();
+}
+
+
+void Device::fireTrigger(MWTime time) {
+    // This runs on the thread that set the trigger variable, so it must not wait for the device.
+    // The trigger's own timestamp is on the MWorks clock, which the device clock departs from only
+    // when it's virtual.
+    MWTime triggerTime = time;
+    if (clock->isVirtual()) {
+        triggerTime += clock->getCurrentTimeUS() - Clock::instance()->getCurrentTimeUS();
+    }
+    {
+        lock_guard triggerLock(triggerMutex);
+        if (!triggerPending) {
+            // Triggers that arrive before the run starts are coalesced into the first
+            triggerPending = true;
+            pendingTriggerTime = triggerTime;
+            pendingTriggerEpoch = abortEpoch;
+        }
+    }
+    triggerCondition.notify_one();
+}
+
+
+void Device::triggerLoop() {
+    unique_lock triggerLock(triggerMutex);
+    
+    while (true) {
+        triggerCondition.wait(triggerLock, [this]() { return triggerShutdown || triggerPending; });
+        if (triggerShutdown) {
+            return;
+        }
+        
+        const MWTime triggerTime = pendingTriggerTime;
+        const std::uint64_t epoch = pendingTriggerEpoch;
+        triggerPending = false;
+        
+        triggerLock.unlock();
+        runTriggered(triggerTime, epoch);
+        triggerLock.lock();
+    }
+}
+
+
+void Device::runTriggered(MWTime triggerTime, std::uint64_t epoch) {
+    TraceSpan span(trace.get(), "trigger", "trigger");
+    
+    auto lock = lockDevice();
+    
+    // Ask the driver only if a run may still be playing.  Otherwise, the first command sent is
+    // StartFilePlaying.
+    if (filePlaying && !checkIfFileStopped()) {
+        return;
+    }
+    if (filePlaying) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver trigger ignored: LED driver is already running");
+        return;
+    }
+    
+    readIntensityInput();
+    
+    // Start only a file that is already on the driver, since uploading one would defeat the purpose
+    if (lastRunDuration == 0) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver trigger ignored: no LED program has been prepared");
+        return;
+    }
+    if (!fileIsCurrent(lastRunDuration)) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN,
+               "LED driver trigger ignored: channel intensities have changed since the LED program was prepared");
+        return;
+    }
+    
+    // Delaying a triggered run would defeat the purpose, too
+    if (!checkThermalLimit(exposureDuration)) {
+        return;
+    }
+    
+    if (startFilePlaying(epoch) && triggerLatency) {
+        triggerLatency->setValue(runStartTime - triggerTime);
+    }
+}
+
+
+void Device::submitIntensityUpdate() {
+    if (!coalesceUpdates) {
+        return;
+    }
+    
+    updatesSubmitted++;
+    if (uploadPending) {
+        // The previous update hasn't been uploaded yet, and now it never will be
+        updatesCoalesced++;
+    }
+    uploadPending = true;
+    uploadCondition.notify_one();
+}
+
+
+void Device::uploadLoop() {
+    // Not lockDevice, which would wait for this thread's own uploads
+    unique_lock lock(mutex);
+    
+    // Duration of an upload that was superseded before it could be recorded
+    MWTime supersededDuration = 0;
+    
+    while (true) {
+        uploadCondition.wait(lock, [this]() { return uploadShutdown || uploadPending; });
+        if (uploadShutdown) {
+            return;
+        }
+        
+        // Updates submitted while this upload is in progress collapse into a single pending update,
+        // so at most one upload is ever queued
+        uploadPending = false;
+        
+        // Without a known duration, or while a run may be in progress, the next run uploads the
+        // intensities instead.  Checking whether the run has ended would require I/O while holding
+        // mutex.
+        MWTime duration = lastRunDuration;
+        if (duration <= 0) {
+            duration = (supersededDuration > 0 ? supersededDuration : defaultDuration);
+        }
+        supersededDuration = 0;
+        if (duration <= 0 || filePlaying) {
+            continue;
+        }
+        
+        readIntensityInput();
+        
+        WORD period;
+        std::size_t samplesUsed;
+        if (fileIsCurrent(duration) || !quantizeDuration(duration, period, samplesUsed)) {
+            continue;
+        }
+        
+        // Send a copy of the intensities without holding mutex, so that setters never wait for the
+        // USB link.  Until the upload finishes, the contents of the driver's file are unknown.
+        const auto words = intensity;
+        const auto submitted = updatesSubmitted;
+        const bool periodChanged = (period != loadedPeriod);
+        lastRunDuration = 0;
+        uploadInProgress = true;
+        
+        // The transfer may have to read acknowledgements of aborts sent in the meantime, but
+        // applying them changes device state, so that waits until mutex is held again
+        deferAbortAcks = true;
+        lock.unlock();
+        
+        bool success;
+        {
+            TraceSpan span(trace.get(), "coalesced upload", "upload");
+            success = ((!periodChanged || setFileTimePeriod(period)) && loadFile(words, samplesUsed));
+        }
+        
+        lock.lock();
+        uploadInProgress = false;
+        uploadFinished.notify_all();
+        
+        deferAbortAcks = false;
+        std::vector<AbortAck> abortAcks;
+        abortAcks.swap(deferredAbortAcks);
+        applyAbortAcks(abortAcks);
+        
+        if (success) {
+            updatesDelivered++;
+            if (updatesSubmitted == submitted) {
+                recordLoadedFile(duration, period, samplesUsed, words);
+            } else {
+                // The pending update supersedes this one, and uploads with the same duration
+                supersededDuration = duration;
+            }
+        }
+    }
+}
+
+
+void Device::recordCommandStatus(std::size_t commandIndex, MWTime startTime, MWTime endTime, bool success) {
+    const MWTime latency = endTime - startTime;
+    
+    updateStatus([&](StatusPage::Layout &status) {
+        auto &stats = status.commands[commandIndex];
+        stats.count++;
+        if (!success) {
+            stats.errors++;
+        }
+        stats.totalLatency += latency;
+        stats.maxLatency = std::max(stats.maxLatency, std::uint64_t(latency));
+    });
+}
+
+
+bool Device::checkThermalBudget(MWTime duration, MWTime &delay) {
+    delay = 0;
+    
+    if (!thermalModel) {
+        return true;
+    }
+    
+    const MWTime currentTime = clock->getCurrentTimeUS();
+    double headroom = predictThermalHeadroom(currentTime, duration);
     
-    for (int channelNum : channels) {
-        if ((channelNum < 1) || (channelNum > intensity.size())) {
-            merror(M_IODEVICE_MESSAGE_DOMAIN, "Invalid LED driver channel number: %d", channelNum);
-        } else {
-            intensity[channelNum - 1] = wordValue;
+    if (headroom < 0.0) {
+        const MWTime maxDelay = maxThermalDelayTimeConstants * thermalModel->getTimeConstant();
+        
+        if (thermalRejectOnly || predictThermalHeadroom(currentTime + maxDelay, duration) < 0.0) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN,
+                   "LED driver run rejected: predicted temperature exceeds thermal limit by %g°C",
+                   -headroom);
+            if (thermalHeadroom) {
+                thermalHeadroom->setValue(headroom);
+            }
+            return false;
+        }
+        
+        // Find the shortest delay after which the run stays within the limit
+        MWTime minDelay = 0;
+        delay = maxDelay;
+        while (delay - minDelay > thermalDelayResolution) {
+            const MWTime midDelay = minDelay + (delay - minDelay) / 2;
+            if (predictThermalHeadroom(currentTime + midDelay, duration) < 0.0) {
+                minDelay = midDelay;
+            } else {
+                delay = midDelay;
+            }
         }
+        
+        headroom = predictThermalHeadroom(currentTime + delay, duration);
+        mwarning(M_IODEVICE_MESSAGE_DOMAIN,
+                 "Delaying LED driver run by %g ms to stay within thermal limit (predicted headroom: %g°C)",
+                 double(delay) / 1e3,
+                 headroom);
     }
     
-    intensityChanged = true;
-}
-
-
-void Device::prepare(MWTime duration) {
-    lock_guard lock(mutex);
-    updateFile(duration);
+    if (thermalHeadroom) {
+        thermalHeadroom->setValue(headroom);
+    }
+    
+    return true;
 }
 
 
-void Device::run(MWTime duration) {
-    lock_guard lock(mutex);
-    if (updateFile(duration)) {
-        startFilePlaying();
+bool Device::checkThermalLimit(MWTime duration) {
+    if (!thermalModel) {
+        return true;
     }
+    
+    const double headroom = predictThermalHeadroom(clock->getCurrentTimeUS(), duration);
+    if (thermalHeadroom) {
+        thermalHeadroom->setValue(headroom);
+    }
+    
+    if (headroom < 0.0) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN,
+               "LED driver run rejected: predicted temperature exceeds thermal limit by %g°C",
+               -headroom);
+        return false;
+    }
+    
+    return true;
 }
 
 
-void Device::stop() {
-    lock_guard lock(mutex);
-    stopFilePlaying();
+double Device::predictThermalHeadroom(MWTime startTime, MWTime duration) const {
+    const auto peak = thermalModel->predictRun(startTime, duration, intensity);
+    return thermalLimit - *std::max_element(peak.begin(), peak.end());
 }
 
 
-static void announceTemp(const VariablePtr &var, WORD rawValue, double pullup) {
-    if (var) {
-        auto value = double(rawValue);
-        
-        if (pullup == 0.0) {
-            // For compatibility with old firmware that pre-calculated temperature and sent it
-            // in millidegrees Celsius
-            value /= 1000.0;
-        } else {
-            // Calculate resistance value of thermistor in kΩ with a voltage divider with the
-            // specified pullup resistance
-            value = pullup / ((double(0xFFFF) / value) - 1.0);
-            
-            // Calculate temperature in Celsius (linear fit)
-            value = -4.4617 * value + 66.0;
+void Device::readIntensityInput() {
+    if (intensityInput && intensityInput->read(intensity, inputControlled)) {
+        for (std::size_t i = 0; i < numChannels; i++) {
+            if (inputControlled[i]) {
+                powerControlled[i] = false;
+            }
         }
-        
-        var->setValue(value);
+        intensityChanged = true;
     }
 }
 
 
-void Device::readTemps() {
-    lock_guard lock(mutex);
-    
-    auto currentTempCalc = tempCalc->getValue().getString();
-    boost::algorithm::to_lower(currentTempCalc);
-    double pullup = 0.0;
-    
-    if (currentTempCalc == "5k") {
-        pullup = 5.0;
-    } else if (currentTempCalc == "10k") {
-        pullup = 10.0;
-    } else if (currentTempCalc != "none") {
-        merror(M_IODEVICE_MESSAGE_DOMAIN,
-               "LED driver temperature calculation type (\"%s\") is invalid; using \"none\" instead",
-               currentTempCalc.c_str());
+bool Device::fileIsCurrent(MWTime duration) {
+    if (duration != lastRunDuration) {
+        return false;
     }
     
-    if (!simulateDevice) {
-        ThermistorValuesRequest request;
-        ThermistorValuesResponse response;
-        
-        if (!perform(request, response)) {
-            return;
-        }
-        
-        announceTemp(tempA, response.getBody().tempA, pullup);
-        announceTemp(tempB, response.getBody().tempB, pullup);
-        announceTemp(tempC, response.getBody().tempC, pullup);
-        announceTemp(tempD, response.getBody().tempD, pullup);
+    // Setting intensities to the values already loaded doesn't require a new file
+    if (intensityChanged && intensity == loadedIntensity) {
+        intensityChanged = false;
     }
+    
+    return !intensityChanged;
 }
 
 
@@ -247,65 +1718,106 @@ bool Device::updateFile(MWTime duration) {
         return false;
     }
     
-    if (intensityChanged || (duration != lastRunDuration)) {
+    readIntensityInput();
+    
+    if (!fileIsCurrent(duration)) {
         WORD period;
         std::size_t samplesUsed;
         
+        // If the upload fails, the contents of the driver's file are unknown
+        lastRunDuration = 0;
+        
         if (!(quantizeDuration(duration, period, samplesUsed) &&
-              setFileTimePeriod(period) &&
-              loadFile(samplesUsed)))
+              (period == loadedPeriod || setFileTimePeriod(period)) &&
+              loadFile(intensity, samplesUsed)))
         {
             return false;
         }
         
-        intensityChanged = false;
-        lastRunDuration = duration;
-        
-        if (samplesUsed < numSamples) {
-            mwarning(M_IODEVICE_MESSAGE_DOMAIN,
-                     "LED driver run duration (%g ms) requires %g ms of padding after end of exposure "
-                     "(all LEDs will be off during this interval)",
-                     double(duration) / 1e3,
-                     double((numSamples - samplesUsed) * period * periodIncrement) / 1e3);
-        }
+        recordLoadedFile(duration, period, samplesUsed, intensity);
     }
     
     return true;
 }
 
 
+void Device::recordLoadedFile(MWTime duration,
+                              WORD period,
+                              std::size_t samplesUsed,
+                              const std::array<WordValue, numChannels> &words)
+{
+    intensityChanged = (intensity != words);
+    loadedIntensity = words;
+    lastRunDuration = duration;
+    exposureDuration = duration;
+    loadedSamplesUsed = samplesUsed;
+    loadedSampleMasks.clear();
+    
+    updateStatus([&](StatusPage::Layout &status) {
+        std::copy(words.begin(), words.end(), status.intensity.begin());
+        status.samplePeriod = MWTime(period) * periodIncrement;
+        status.samplesUsed = samplesUsed;
+    });
+    
+    // The driver plays the entire file, including any padding
+    fileDuration = (simulateDevice ? duration : MWTime(numSamples) * MWTime(period) * periodIncrement);
+    
+    if (samplesUsed < numSamples && !releasePadding) {
+        mwarning(M_IODEVICE_MESSAGE_DOMAIN,
+                 "LED driver run duration (%g ms) requires %g ms of padding after end of exposure "
+                 "(all LEDs will be off during this interval)",
+                 double(duration) / 1e3,
+                 double((numSamples - samplesUsed) * period * periodIncrement) / 1e3);
+    }
+}
+
+
 bool Device::quantizeDuration(MWTime duration, WORD &period, std::size_t &samplesUsed) {
-    if (duration < minDuration || duration > maxDuration) {
-        merror(M_IODEVICE_MESSAGE_DOMAIN,
-               "LED driver run duration must be between %g ms and %g s",
-               double(minDuration) / 1e3,
-               double(maxDuration) / 1e6);
-        return false;
+    auto iter = stagedDurations.find(duration);
+    if (iter != stagedDurations.end()) {
+        period = iter->second.period;
+        samplesUsed = iter->second.samplesUsed;
+    } else {
+        const auto errorMessage = computeQuantization(duration, period, samplesUsed);
+        if (!errorMessage.empty()) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "%s", errorMessage.c_str());
+            return false;
+        }
     }
     
-    if (duration % periodIncrement != 0) {
-        merror(M_IODEVICE_MESSAGE_DOMAIN,
-               "LED driver run duration must be a multiple of %g ms",
-               double(periodIncrement) / 1e3);
-        return false;
+    if (compensateDrift && driftEstimator.isReady()) {
+        compensateForDrift(duration, period, samplesUsed);
     }
     
-    const MWTime normDuration = duration / periodIncrement;
-    const MWTime normPeriodMin = MWTime(std::ceil(double(normDuration) / double(numSamples)));
-    const MWTime normPeriodMax = std::min(normDuration, maxDuration / periodIncrement);
+    return true;
+}
+
+
+void Device::compensateForDrift(MWTime duration, WORD &period, std::size_t &samplesUsed) {
+    // Choose the period and sample count whose duration in host time is closest to the requested
+    // one.  Prefer shorter periods on ties, as computeQuantization does.
+    const double ratio = driftEstimator.getRatio();
+    const double targetDriverDuration = double(duration) / ratio;
+    double bestError = std::numeric_limits<double>::infinity();
     
-    for (MWTime normPeriod = normPeriodMin; normPeriod <= normPeriodMax; normPeriod++) {
-        if (normDuration % normPeriod == 0) {
-            period = normPeriod;
-            samplesUsed = normDuration / normPeriod;
-            return true;
+    for (std::size_t samples = numSamples; samples >= 1; samples--) {
+        const double idealPeriod = targetDriverDuration / double(MWTime(samples) * periodIncrement);
+        const auto candidatePeriod = WORD(std::min(std::max(std::round(idealPeriod), 1.0),
+                                                   double(std::numeric_limits<WORD>::max())));
+        const double hostDuration = double(MWTime(samples) * MWTime(candidatePeriod) * periodIncrement) * ratio;
+        const double error = std::abs(hostDuration - double(duration));
+        
+        if (error < bestError) {
+            bestError = error;
+            period = candidatePeriod;
+            samplesUsed = samples;
         }
     }
     
-    merror(M_IODEVICE_MESSAGE_DOMAIN,
-           "Requested run duration (%g ms) is not compatible with LED driver",
-           double(duration) / 1e3);
-    return false;
+    const double residual = double(MWTime(samplesUsed) * MWTime(period) * periodIncrement) * ratio - double(duration);
+    if (durationResidual) {
+        durationResidual->setValue(residual);
+    }
 }
 
 
@@ -325,49 +1837,88 @@ bool Device::setFileTimePeriod(WORD period) {
         }
     }
     
+    loadedPeriod = period;
+    
     return true;
 }
 
 
-bool Device::loadFile(std::size_t samplesUsed) {
-    if (!simulateDevice) {
-        LoadFileRequest request;
-        auto &samples = request.getBody().samples;
-        
-        for (std::size_t i = 0; i < samples.size(); i++) {
-            if (i < samplesUsed) {
-                samples[i] = intensity;
-            } else {
-                samples[i].fill(WordValue::zero());
-            }
-        }
-        
-        LoadFileResponse response;
-        
-        if (!perform(request, response)) {
-            return false;
+bool Device::loadFile(const std::array<WordValue, numChannels> &words, std::size_t samplesUsed) {
+    if (simulateDevice) {
+        return true;
+    }
+    
+    LoadFileRequest request;
+    auto &samples = request.getBody().samples;
+    
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        if (i < samplesUsed) {
+            samples[i] = words;
+        } else {
+            samples[i].fill(WordValue::zero());
         }
-        
-        if (!response.getBody().fileLoaded) {
-            merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver failed to load file");
-            return false;
+    }
+    
+    return sendFile(request);
+}
+
+
+bool Device::loadPulseTrain(const PulseTrainEncoding &encoding) {
+    if (simulateDevice) {
+        return true;
+    }
+    
+    LoadFileRequest request;
+    auto &samples = request.getBody().samples;
+    
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+            samples[i][channelIndex] = (encoding.on[i][channelIndex] ? intensity[channelIndex] : WordValue::zero());
         }
     }
     
+    return sendFile(request);
+}
+
+
+bool Device::sendFile(LoadFileRequest &request) {
+    LoadFileResponse response;
+    
+    if (!perform(request, response)) {
+        return false;
+    }
+    
+    if (!response.getBody().fileLoaded) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver failed to load file");
+        return false;
+    }
+    
     return true;
 }
 
 
-bool Device::startFilePlaying() {
+bool Device::startFilePlaying(std::uint64_t epoch) {
+    if (doseLimit > 0.0 && !checkDoseLimit()) {
+        return false;
+    }
+    
     if (simulateDevice) {
-        simulatedRunStartTime = clock->getCurrentTimeUS();
+        {
+            lock_guard transportLock(transportMutex);
+            if (epoch != abortEpoch) {
+                return false;
+            }
+        }
+        runStartTime = clock->getCurrentTimeUS();
     } else {
         StartFilePlayingRequest request;
         StartFilePlayingResponse response;
         
-        if (!perform(request, response)) {
+        const MWTime beforeStart = clock->getCurrentTimeUS();
+        if (!perform(request, response, epoch)) {
             return false;
         }
+        runStartTime = (beforeStart + clock->getCurrentTimeUS()) / 2;
         
         if (!response.getBody().filePlaying) {
             merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver failed to start file play");
@@ -376,6 +1927,24 @@ bool Device::startFilePlaying() {
     }
     
     filePlaying = true;
+    if (thermalModel) {
+        thermalModel->addRun(runStartTime, exposureDuration, loadedIntensity);
+    }
+    updateStatus([](StatusPage::Layout &status) { status.running = true; });
+    if (trace) {
+        trace->recordCounter("running", 1.0);
+    }
+    
+    lastPlayingTime = runStartTime;
+    releasingPadding = (releasePadding && !simulateDevice && loadedSamplesUsed < numSamples);
+    if (clock->isVirtual()) {
+        scheduleVirtualRunCompletion();
+    } else if (releasingPadding) {
+        scheduleRelease();
+    } else if (verifyDuration) {
+        scheduleStopPoll();
+    }
+    
     if (running && !running->getValue().getBool()) {
         running->setValue(true);
     }
@@ -384,27 +1953,186 @@ bool Device::startFilePlaying() {
 }
 
 
+void Device::scheduleVirtualRunCompletion() {
+    // Nothing else happens on the simulated device until the run ends, so advance to its stop time
+    // almost right away, rather than waiting for the next status check
+    boost::weak_ptr<Device> weakThis(component_shared_from_this<Device>());
+    const MWTime startTime = runStartTime;
+    
+    Scheduler::instance()->scheduleUS(FILELINE,
+                                      std::min(fileDuration, virtualRunCompletionDelay),
+                                      0,
+                                      1,
+                                      [weakThis, startTime]() {
+                                          if (auto sharedThis = weakThis.lock()) {
+                                              auto lock = sharedThis->lockDevice();
+                                              // Skip if the run has already been stopped or superseded
+                                              if (sharedThis->filePlaying && sharedThis->runStartTime == startTime) {
+                                                  sharedThis->clock->advanceTo(startTime + sharedThis->fileDuration);
+                                                  sharedThis->checkIfFileStopped();
+                                              }
+                                          }
+                                          return nullptr;
+                                      },
+                                      M_DEFAULT_IODEVICE_PRIORITY,
+                                      M_DEFAULT_IODEVICE_WARN_SLOP_US,
+                                      M_DEFAULT_IODEVICE_FAIL_SLOP_US,
+                                      M_MISSED_EXECUTION_DROP);
+}
+
+
+void Device::scheduleStopPoll() {
+    // Poll at a high rate from shortly before the expected stop time until the run ends, so that the
+    // stop time (and hence the actual duration) is measured precisely
+    if (stopPollTask) {
+        stopPollTask->cancel();
+    }
+    
+    boost::weak_ptr<Device> weakThis(component_shared_from_this<Device>());
+    const MWTime startTime = runStartTime;
+    const MWTime pollDelay = std::max(MWTime(0),
+                                      runStartTime + fileDuration - stopPollLeadTime - clock->getCurrentTimeUS());
+    
+    stopPollTask = Scheduler::instance()->scheduleUS(FILELINE,
+                                                     pollDelay,
+                                                     stopPollInterval,
+                                                     M_REPEAT_INDEFINITELY,
+                                                     [weakThis, startTime]() {
+                                                         if (auto sharedThis = weakThis.lock()) {
+                                                             TraceSpan span(sharedThis->trace.get(), "stop poll", "poll");
+                                                             auto lock = sharedThis->lockDevice();
+                                                             if (sharedThis->filePlaying && sharedThis->runStartTime == startTime) {
+                                                                 sharedThis->checkIfFileStopped();
+                                                             }
+                                                         }
+                                                         return nullptr;
+                                                     },
+                                                     M_DEFAULT_IODEVICE_PRIORITY,
+                                                     M_DEFAULT_IODEVICE_WARN_SLOP_US,
+                                                     M_DEFAULT_IODEVICE_FAIL_SLOP_US,
+                                                     M_MISSED_EXECUTION_DROP);
+}
+
+
+void Device::scheduleRelease() {
+    // Stop the driver as soon as the last lit sample has played, rather than waiting for it to play
+    // out the dark padding at the end of the file.  Stopping late only shortens the padding, so the
+    // task is scheduled for the exact end of exposure, and scheduler slop can never truncate it.
+    if (releaseTask) {
+        releaseTask->cancel();
+    }
+    
+    boost::weak_ptr<Device> weakThis(component_shared_from_this<Device>());
+    const MWTime startTime = runStartTime;
+    const MWTime exposureEnd = exposureEndTime();
+    const MWTime releaseDelay = std::max(MWTime(0), exposureEnd - clock->getCurrentTimeUS());
+    
+    releaseTask = Scheduler::instance()->scheduleUS(FILELINE,
+                                                    releaseDelay,
+                                                    0,
+                                                    1,
+                                                    [weakThis, startTime, exposureEnd]() {
+                                                        if (auto sharedThis = weakThis.lock()) {
+                                                            TraceSpan span(sharedThis->trace.get(), "release padding", "poll");
+                                                            auto lock = sharedThis->lockDevice();
+                                                            // Skip if the run has already been stopped or superseded
+                                                            if (sharedThis->filePlaying && sharedThis->runStartTime == startTime) {
+                                                                StopFilePlayingRequest request;
+                                                                StopFilePlayingResponse response;
+                                                                if (sharedThis->perform(request, response) &&
+                                                                    !response.getBody().filePlaying)
+                                                                {
+                                                                    sharedThis->fileStoppedAt(exposureEnd);
+                                                                } else {
+                                                                    mwarning(M_IODEVICE_MESSAGE_DOMAIN,
+                                                                             "LED driver failed to stop file play at end of "
+                                                                             "exposure; run will end after padding");
+                                                                }
+                                                            }
+                                                        }
+                                                        return nullptr;
+                                                    },
+                                                    M_DEFAULT_IODEVICE_PRIORITY,
+                                                    M_DEFAULT_IODEVICE_WARN_SLOP_US,
+                                                    M_DEFAULT_IODEVICE_FAIL_SLOP_US,
+                                                    M_MISSED_EXECUTION_DROP);
+}
+
+
+MWTime Device::exposureEndTime() const {
+    // The last lit sample ends after samplesUsed periods of the driver's clock.  When drift
+    // compensation is active, convert that to host time, as compensateForDrift does.
+    double driverDuration = double(MWTime(loadedSamplesUsed) * MWTime(loadedPeriod) * periodIncrement);
+    if (compensateDrift && driftEstimator.isReady()) {
+        driverDuration *= driftEstimator.getRatio();
+    }
+    return runStartTime + MWTime(std::llround(driverDuration));
+}
+
+
+MWTime Device::expectedStopTime() const {
+    return (releasingPadding ? exposureEndTime() : runStartTime + fileDuration);
+}
+
+
+void Device::recordMeasuredDuration() {
+    const MWTime measured = lastStopTime - runStartTime;
+    const MWTime error = measured - fileDuration;
+    
+    durationErrorStats.add(double(error));
+    driftEstimator.addRun(fileDuration, measured);
+    
+    if (measuredDuration) {
+        measuredDuration->setValue(measured);
+    }
+    if (durationError) {
+        durationError->setValue(error);
+    }
+}
+
+
+void Device::RunningStats::add(double value) {
+    count++;
+    const double delta = value - mean;
+    mean += delta / double(count);
+    sumSquaredDeviations += delta * (value - mean);
+    min = (count == 1 ? value : std::min(min, value));
+    max = (count == 1 ? value : std::max(max, value));
+}
+
+
 bool Device::checkIfFileStopped() {
     if (filePlaying) {
         bool fileStopped = false;
+        MWTime stopTime = 0;
         
         if (simulateDevice) {
-            fileStopped = (clock->getCurrentTimeUS() - simulatedRunStartTime) >= lastRunDuration;
+            stopTime = runStartTime + fileDuration;
+            fileStopped = (clock->getCurrentTimeUS() >= stopTime);
         } else {
             IsFilePlayingRequest request;
             IsFilePlayingResponse response;
             
+            const MWTime beforeCheck = clock->getCurrentTimeUS();
             if (!perform(request, response)) {
                 return false;
             }
             
+            // The file stopped at some point between the last check that found it playing and
+            // this one
+            const MWTime checkTime = (beforeCheck + clock->getCurrentTimeUS()) / 2;
             fileStopped = !response.getBody().filePlaying;
+            if (fileStopped) {
+                stopTime = (lastPlayingTime + checkTime) / 2;
+            } else {
+                lastPlayingTime = checkTime;
+            }
         }
         
         if (fileStopped) {
-            filePlaying = false;
-            if (running && running->getValue().getBool()) {
-                running->setValue(false);
+            fileStoppedAt(stopTime);
+            if (verifyDuration) {
+                recordMeasuredDuration();
             }
         }
     }
@@ -429,9 +2157,167 @@ bool Device::stopFilePlaying() {
             }
         }
         
-        filePlaying = false;
-        if (running && running->getValue().getBool()) {
-            running->setValue(false);
+        fileStoppedAt(clock->getCurrentTimeUS());
+    }
+    
+    return true;
+}
+
+
+void Device::fileStoppedAt(MWTime stopTime) {
+    filePlaying = false;
+    lastStopTime = stopTime;
+    if (stopPollTask) {
+        stopPollTask->cancel();
+        stopPollTask.reset();
+    }
+    if (releaseTask) {
+        releaseTask->cancel();
+        releaseTask.reset();
+    }
+    if (thermalModel) {
+        thermalModel->endRun(lastStopTime);
+    }
+    updateStatus([](StatusPage::Layout &status) { status.running = false; });
+    if (trace) {
+        trace->recordCounter("running", 0.0);
+    }
+    if (running && running->getValue().getBool()) {
+        running->setValue(false);
+    }
+    recordDeliveredDose(lastStopTime - runStartTime);
+    if (manifest) {
+        manifest->setValue(manifestEncoder.encode(runStartTime,
+                                                  lastStopTime,
+                                                  MWTime(loadedPeriod) * periodIncrement,
+                                                  loadedSamplesUsed,
+                                                  loadedIntensity,
+                                                  loadedSampleMasks));
+    }
+}
+
+
+void Device::computeRunDose(MWTime elapsed, std::array<double, numChannels> &runDose) const {
+    const MWTime samplePeriod = MWTime(loadedPeriod) * periodIncrement;
+    std::array<double, numChannels> onTime;
+    onTime.fill(0.0);
+    
+    // Padding samples are never lit, and samples after an early stop count only up to the stop
+    for (std::size_t sample = 0; sample < loadedSamplesUsed; sample++) {
+        const MWTime sampleOnTime = std::min(std::max(elapsed - MWTime(sample) * samplePeriod, MWTime(0)),
+                                             samplePeriod);
+        const std::uint64_t mask = (loadedSampleMasks.empty() ? ~std::uint64_t(0) : loadedSampleMasks[sample]);
+        for (std::size_t i = 0; i < numChannels; i++) {
+            onTime[i] += double((mask >> i) & 1) * double(sampleOnTime);
+        }
+    }
+    
+    for (std::size_t i = 0; i < numChannels; i++) {
+        runDose[i] = (double(WORD(loadedIntensity[i])) / double(std::numeric_limits<WORD>::max())) * onTime[i] / 1e6;
+    }
+}
+
+
+bool Device::checkDoseLimit() {
+    std::array<double, numChannels> runDose;
+    computeRunDose(std::numeric_limits<MWTime>::max() / 2, runDose);
+    
+    for (std::size_t i = 0; i < numChannels; i++) {
+        if (deliveredDose[i] + runDose[i] > doseLimit) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN,
+                   "LED driver run rejected: channel %lu would exceed dose limit (delivered: %g, run: %g, limit: %g)",
+                   i + 1,
+                   deliveredDose[i],
+                   runDose[i],
+                   doseLimit);
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+
+void Device::recordDeliveredDose(MWTime elapsed) {
+    std::array<double, numChannels> runDose;
+    computeRunDose(elapsed, runDose);
+    for (std::size_t i = 0; i < numChannels; i++) {
+        deliveredDose[i] += runDose[i];
+    }
+    
+    if (dose) {
+        dose->setValue(Datum(Datum::list_value_type(deliveredDose.begin(), deliveredDose.end())));
+    }
+}
+
+
+bool Device::finishAborts() {
+    if (deferAbortAcks) {
+        return readAbortAcks(deferredAbortAcks);
+    }
+    
+    std::vector<AbortAck> acks;
+    const bool success = readAbortAcks(acks);
+    return (applyAbortAcks(acks) && success);
+}
+
+
+bool Device::readAbortAcks(std::vector<AbortAck> &acks) {
+    while (true) {
+        MWTime sendTime;
+        {
+            lock_guard transportLock(transportMutex);
+            if (pendingAborts.empty()) {
+                return true;
+            }
+            sendTime = pendingAborts.front();
+        }
+        
+        StopFilePlayingResponse response;
+        bool success;
+        {
+            TraceSpan readSpan(trace.get(), StopFilePlayingCommand::name(), "read");
+            success = response.read(*transport);
+        }
+        const MWTime ackTime = clock->getCurrentTimeUS();
+        
+        {
+            lock_guard transportLock(transportMutex);
+            pendingAborts.pop_front();
+        }
+        
+        acks.push_back({ sendTime, ackTime, success, success && response.getBody().filePlaying });
+        if (!success) {
+            return false;
+        }
+    }
+}
+
+
+bool Device::applyAbortAcks(const std::vector<AbortAck> &acks) {
+    for (const auto &ack : acks) {
+        recordCommandStatus(Protocol::CommandFor<StopFilePlayingRequest>::index,
+                            ack.sendTime,
+                            ack.ackTime,
+                            ack.success);
+        if (!ack.success) {
+            return false;
+        }
+        
+        if (ack.filePlaying) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver failed to stop file play");
+            return false;
+        }
+        
+        mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+                "LED driver abort acknowledged %g ms after stop command",
+                double(ack.ackTime - ack.sendTime) / 1e3);
+        if (abortLatency) {
+            abortLatency->setValue(ack.ackTime - ack.sendTime);
+        }
+        
+        if (filePlaying) {
+            fileStoppedAt((ack.sendTime + ack.ackTime) / 2);
         }
     }
     
@@ -9,7 +9,19 @@
 #ifndef __BlackrockLEDDriver__BlackrockLEDDriverDevice__
 #define __BlackrockLEDDriver__BlackrockLEDDriverDevice__
 
+#include "BlackrockLEDDriverCalibration.hpp"
+#include "BlackrockLEDDriverClock.hpp"
 #include "BlackrockLEDDriverCommand.h"
+#include "BlackrockLEDDriverConnectionRegistry.hpp"
+#include "BlackrockLEDDriverDriftEstimator.hpp"
+#include "BlackrockLEDDriverIntensityInput.hpp"
+#include "BlackrockLEDDriverLayout.hpp"
+#include "BlackrockLEDDriverManifest.hpp"
+#include "BlackrockLEDDriverPulseTrain.hpp"
+#include "BlackrockLEDDriverStatusPage.hpp"
+#include "BlackrockLEDDriverThermalModel.hpp"
+#include "BlackrockLEDDriverTrace.hpp"
+#include "BlackrockLEDDriverTransport.hpp"
 
 
 BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -25,6 +37,43 @@ public:
     static const std::string TEMP_D;
     static const std::string TEMP_CALC;
     static const std::string SIMULATE_DEVICE;
+    static const std::string SIMULATION_TIME;
+    static const std::string LATENCY_TIMER;
+    static const std::string USB_IN_TRANSFER_SIZE;
+    static const std::string USB_OUT_TRANSFER_SIZE;
+    static const std::string EVENT_CHAR;
+    static const std::string CALIBRATE_LINK;
+    static const std::string CAPTURE_FILE;
+    static const std::string REPLAY_FILE;
+    static const std::string REPLAY_TIMING;
+    static const std::string ACHIEVED_GAP;
+    static const std::string CALIBRATION_FILE;
+    static const std::string LAYOUT_FILE;
+    static const std::string THERMAL_LIMIT;
+    static const std::string THERMAL_TIME_CONSTANT;
+    static const std::string THERMAL_GAIN;
+    static const std::string THERMAL_POLICY;
+    static const std::string THERMAL_HEADROOM;
+    static const std::string BACKGROUND_OPEN;
+    static const std::string DEFAULT_DURATION;
+    static const std::string STATUS_PAGE;
+    static const std::string ABORT_LATENCY;
+    static const std::string TRACE_FILE;
+    static const std::string VERIFY_DURATION;
+    static const std::string MEASURED_DURATION;
+    static const std::string DURATION_ERROR;
+    static const std::string COMPENSATE_DRIFT;
+    static const std::string DURATION_RESIDUAL;
+    static const std::string TRIGGER;
+    static const std::string TRIGGER_LATENCY;
+    static const std::string PERSISTENT_CONNECTION;
+    static const std::string TELEMETRY;
+    static const std::string MANIFEST;
+    static const std::string DOSE;
+    static const std::string DOSE_LIMIT;
+    static const std::string INTENSITY_INPUT;
+    static const std::string COALESCE_UPDATES;
+    static const std::string RELEASE_PADDING;
     
     static void describeComponent(ComponentInfo &info);
     
@@ -35,49 +84,322 @@ public:
     bool stopDeviceIO() override;
     
     void setIntensity(const std::set<int> &channels, double value);
+    void setPower(const std::set<int> &channels, double power);
+    void setPattern(const PatternSpec &spec);
+    
+    // Validates and quantizes a duration that is known at load time.  Throws if it is invalid.
+    void stageDuration(MWTime duration);
+    
     void prepare(MWTime duration);
     void run(MWTime duration);
+    void queueRun(MWTime duration, MWTime gap);
+    bool runPulseTrain(const PulseTrainSpec &spec, MWTime &timingError);
     void stop();
+    void abort();
     void readTemps();
     
 private:
+    bool connect();
+    bool openHandle();
+    bool adoptConnection(const RetainedConnection &retained);
+    void closeHandle();
+    
+    struct LinkProfile {
+        UCHAR latencyTimer;
+        ULONG inTransferSize;
+        ULONG outTransferSize;
+    };
+    
+    bool configureLink();
+    bool applyLinkProfile(const LinkProfile &profile);
+    bool calibrateLink(LinkProfile &profile);
+    bool measureLinkProfile(const LinkProfile &profile, MWTime &roundTripTime, MWTime &loadFileTime);
+    
+    struct QueuedRun {
+        std::array<WordValue, numChannels> intensity;
+        MWTime duration;
+        MWTime gap;
+        MWTime queueTime;
+    };
+    
+    void runQueueLoop();
+    bool performQueuedRun(const QueuedRun &queuedRun, std::uint64_t generation);
+    bool waitForFileStopped(std::uint64_t generation);
+    bool waitForRunQueue(MWTime targetTime, std::uint64_t generation);
+    void clearRunQueue();
+    
+    void fireTrigger(MWTime time);
+    void triggerLoop();
+    void runTriggered(MWTime triggerTime, std::uint64_t epoch);
+    
+    void submitIntensityUpdate();
+    void uploadLoop();
+    
+    bool checkThermalBudget(MWTime duration, MWTime &delay);
+    bool checkThermalLimit(MWTime duration);
+    double predictThermalHeadroom(MWTime startTime, MWTime duration) const;
+    
+    void announceTelemetry(MWTime readTime,
+                           const std::array<WORD, ThermalModel::numBanks> &rawValues,
+                           const std::array<double, ThermalModel::numBanks> &temps);
+    
+    void readIntensityInput();
+    bool fileIsCurrent(MWTime duration);
     bool updateFile(MWTime duration);
     bool quantizeDuration(MWTime duration, WORD &period, std::size_t &samplesUsed);
+    void compensateForDrift(MWTime duration, WORD &period, std::size_t &samplesUsed);
     bool setFileTimePeriod(WORD period);
-    bool loadFile(std::size_t samplesUsed);
-    bool startFilePlaying();
+    bool loadFile(const std::array<WordValue, numChannels> &words, std::size_t samplesUsed);
+    void recordLoadedFile(MWTime duration,
+                          WORD period,
+                          std::size_t samplesUsed,
+                          const std::array<WordValue, numChannels> &words);
+    bool loadPulseTrain(const PulseTrainEncoding &encoding);
+    bool sendFile(LoadFileRequest &request);
+    bool startFilePlaying(std::uint64_t epoch);
+    void scheduleVirtualRunCompletion();
+    void scheduleStopPoll();
+    void scheduleRelease();
+    MWTime exposureEndTime() const;
+    MWTime expectedStopTime() const;
+    void recordMeasuredDuration();
     bool checkIfFileStopped();
     bool stopFilePlaying();
+    void fileStoppedAt(MWTime stopTime);
+    
+    // Dose is intensity (0-1) times on-time in seconds, per channel
+    void computeRunDose(MWTime elapsed, std::array<double, numChannels> &runDose) const;
+    bool checkDoseLimit();
+    void recordDeliveredDose(MWTime elapsed);
     
-    template<typename Request, typename Response>
-    bool perform(Request &request, Response &response) { return request.write(handle) && response.read(handle); }
+    template<typename Request>
+    bool perform(Request &request, ResponseFor<Request> &response, std::uint64_t epoch = anyAbortEpoch) {
+        if (!transport) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver is not connected");
+            return false;
+        }
+        using Command = typename Protocol::CommandFor<Request>::type;
+        const MWTime startTime = (statusPage ? clock->getCurrentTimeUS() : 0);
+        bool success;
+        bool cancelled = false;
+        {
+            TraceSpan span(trace.get(), Command::name(), "write");
+            success = writeRequest(request, epoch, cancelled);
+        }
+        if (cancelled) {
+            return false;
+        }
+        if (success) {
+            TraceSpan span(trace.get(), Command::name(), "read");
+            success = response.read(*transport);
+        }
+        if (statusPage) {
+            recordCommandStatus(Protocol::CommandFor<Request>::index, startTime, clock->getCurrentTimeUS(), success);
+        }
+        return success;
+    }
     
     template<typename Message>
     bool perform(Message &message) { return perform(message, message); }
     
+    // Writes the request once all pending aborts are acknowledged, so that the next response read
+    // belongs to it.  If abort() has been called since epoch was captured, the request is cancelled
+    // instead, so that a run that was about to start when the driver was aborted never does.
+    template<typename Request>
+    bool writeRequest(Request &request, std::uint64_t epoch, bool &cancelled) {
+        while (true) {
+            if (!finishAborts()) {
+                return false;
+            }
+            lock_guard transportLock(transportMutex);
+            if (pendingAborts.empty()) {
+                if (epoch != anyAbortEpoch && epoch != abortEpoch) {
+                    cancelled = true;
+                    return false;
+                }
+                return request.write(*transport);
+            }
+        }
+    }
+    
+    struct AbortAck {
+        MWTime sendTime;
+        MWTime ackTime;
+        bool success;
+        bool filePlaying;
+    };
+    
+    // Reads the acknowledgements of all pending aborts and applies them, unless deferAbortAcks is
+    // set, in which case they're only read, and are applied when uploadThread reacquires mutex
+    bool finishAborts();
+    bool readAbortAcks(std::vector<AbortAck> &acks);
+    bool applyAbortAcks(const std::vector<AbortAck> &acks);
+    
+    void recordCommandStatus(std::size_t commandIndex, MWTime startTime, MWTime endTime, bool success);
+    
+    template<typename Function>
+    void updateStatus(Function &&function) {
+        if (statusPage) {
+            statusPage->update(clock->getCurrentTimeUS(), std::forward<Function>(function));
+        }
+    }
+    
     const VariablePtr running;
     const VariablePtr tempA;
     const VariablePtr tempB;
     const VariablePtr tempC;
     const VariablePtr tempD;
     const VariablePtr tempCalc;
+    const VariablePtr achievedGap;
+    const VariablePtr thermalHeadroom;
+    const VariablePtr abortLatency;
+    const VariablePtr measuredDuration;
+    const VariablePtr durationError;
+    const VariablePtr durationResidual;
+    const VariablePtr trigger;
+    const VariablePtr triggerLatency;
+    const VariablePtr telemetry;
+    const VariablePtr manifest;
+    const VariablePtr dose;
     const bool simulateDevice;
+    const int latencyTimer;
+    const long usbInTransferSize;
+    const long usbOutTransferSize;
+    const int eventChar;
+    const bool calibrateLinkOnInit;
+    const bool backgroundOpen;
+    const bool persistentConnection;
+    const bool coalesceUpdates;
+    const bool releasePadding;
+    const bool verifyDuration;
+    const bool compensateDrift;
+    const MWTime defaultDuration;
+    const std::string captureFile;
+    const std::string replayFile;
+    const bool replayOriginalTiming;
+    const std::unique_ptr<IntensityCalibration> calibration;
+    const std::unique_ptr<ChannelLayout> layout;
+    const double thermalLimit;
+    const double doseLimit;
+    const bool thermalRejectOnly;
+    const std::unique_ptr<ThermalModel> thermalModel;
+    const std::unique_ptr<StatusPage> statusPage;
+    const std::unique_ptr<IntensityInput> intensityInput;
     
-    const boost::shared_ptr<Clock> clock;
+    const std::unique_ptr<DeviceClock> clock;
+    const std::unique_ptr<TraceRecorder> trace;
     
     FT_HANDLE handle;
+    std::thread openThread;
+    
+    struct StagedDuration {
+        WORD period;
+        std::size_t samplesUsed;
+    };
+    std::map<MWTime, StagedDuration> stagedDurations;
+    std::unique_ptr<Transport> transport;
     std::array<WordValue, numChannels> intensity;
+    std::array<WordValue, numChannels> loadedIntensity;
+    std::array<double, numChannels> requestedPower;
+    std::array<BYTE, numChannels> powerControlled;
+    std::array<BYTE, numChannels> inputControlled;  // Channels set by intensityInput's latest update
+    WORD loadedPeriod;
+    std::size_t loadedSamplesUsed;
+    std::vector<std::uint64_t> loadedSampleMasks;  // Empty unless a pulse train is loaded
+    RunManifestEncoder manifestEncoder;
     
     boost::shared_ptr<ScheduleTask> checkStatusTask;
+    boost::shared_ptr<ScheduleTask> stopPollTask;
+    boost::shared_ptr<ScheduleTask> releaseTask;
     
     std::mutex mutex;
     using lock_guard = std::lock_guard<std::mutex>;
+    using unique_lock = std::unique_lock<std::mutex>;
+    
+    // Also waits for any background upload to finish, because the caller may use the transport
+    unique_lock lockDevice() {
+        TraceSpan span(trace.get(), "mutex wait", "lock");
+        unique_lock lock(mutex);
+        uploadFinished.wait(lock, [this]() { return !uploadInProgress; });
+        return lock;
+    }
+    
+    // For callers that only change intensities and never use the transport
+    unique_lock lockState() {
+        TraceSpan span(trace.get(), "mutex wait", "lock");
+        return unique_lock(mutex);
+    }
+    
+    // Guards writes to the transport (and replacement of it), so that abort() can send a request
+    // without holding mutex.  Reads happen only with mutex held, or on uploadThread while
+    // uploadInProgress is set.
+    std::mutex transportMutex;
+    std::deque<MWTime> pendingAborts;  // Send times of StopFilePlaying requests awaiting a response
+    
+    // Incremented (with transportMutex held) by every abort.  Each path that starts a run captures it
+    // when it decides to start, and the start is refused if it has changed by the time
+    // StartFilePlaying would be sent.
+    static constexpr std::uint64_t anyAbortEpoch = std::numeric_limits<std::uint64_t>::max();
+    std::atomic<std::uint64_t> abortEpoch;
     
     bool intensityChanged;
     bool filePlaying;
     MWTime lastRunDuration;
+    MWTime fileDuration;
+    MWTime exposureDuration;  // Portion of the file during which LEDs may be on
+    bool releasingPadding;  // Current run will be stopped at the end of exposure
+    MWTime runStartTime;
+    MWTime lastPlayingTime;
+    MWTime lastStopTime;
+    
+    struct RunningStats {
+        std::size_t count = 0;
+        double mean = 0.0;
+        double sumSquaredDeviations = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+        
+        void add(double value);
+        double standardDeviation() const {
+            return (count > 1 ? std::sqrt(sumSquaredDeviations / double(count - 1)) : 0.0);
+        }
+    };
+    std::array<double, numChannels> deliveredDose;
+    RunningStats durationErrorStats;
+    DriftEstimator driftEstimator;
+    
+    std::thread runQueueThread;
+    std::mutex runQueueMutex;
+    std::condition_variable runQueueCondition;
+    std::deque<QueuedRun> runQueue;
+    std::atomic<std::uint64_t> runQueueGeneration;
+    bool runQueueShutdown;
+    
+    // The trigger notification only records the trigger and wakes triggerThread, which does the I/O
+    boost::shared_ptr<VariableNotification> triggerNotification;
+    std::thread triggerThread;
+    std::mutex triggerMutex;
+    std::condition_variable triggerCondition;
+    bool triggerPending;
+    MWTime pendingTriggerTime;
+    std::uint64_t pendingTriggerEpoch;
+    bool triggerShutdown;
     
-    MWTime simulatedRunStartTime;
+    // In coalescing mode, intensity is the only upload slot, so each upload sends the newest
+    // intensities and any intermediate ones are dropped.  Guarded by mutex.  uploadThread releases
+    // mutex during the transfer itself, and sets uploadInProgress so that other users of the
+    // transport wait in lockDevice.
+    std::thread uploadThread;
+    std::condition_variable uploadCondition;
+    std::condition_variable uploadFinished;
+    bool uploadPending;
+    bool uploadInProgress;
+    bool deferAbortAcks;  // Set during an upload, when uploadThread must not change device state
+    std::vector<AbortAck> deferredAbortAcks;
+    bool uploadShutdown;
+    unsigned long long updatesSubmitted;
+    unsigned long long updatesCoalesced;
+    unsigned long long updatesDelivered;
     
 };
 
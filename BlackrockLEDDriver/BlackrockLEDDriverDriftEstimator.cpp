@@ -0,0 +1,74 @@
+//
+//  BlackrockLEDDriverDriftEstimator.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverDriftEstimator.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+// Typical error in a measured duration, and the largest uncertainty in the ratio at which the
+// estimate is used
+constexpr double measurementError = 0.5e-3;  // 0.5 ms
+constexpr double maxRatioError = 100e-6;     // 100 ppm
+
+// Weight given to older runs decays by this factor per run, so the estimate can follow slow changes
+// (e.g. as the driver warms up)
+constexpr double forgettingFactor = 0.999;
+
+
+DriftEstimator::DriftEstimator() :
+    numRuns(0),
+    sumWeights(0.0),
+    sumNominal(0.0),
+    sumMeasured(0.0),
+    sumNominalSquared(0.0),
+    sumNominalMeasured(0.0)
+{ }
+
+
+void DriftEstimator::addRun(MWTime nominalDuration, MWTime measuredDuration) {
+    const double x = double(nominalDuration) / 1e6;
+    const double y = double(measuredDuration) / 1e6;
+    
+    sumWeights = forgettingFactor * sumWeights + 1.0;
+    sumNominal = forgettingFactor * sumNominal + x;
+    sumMeasured = forgettingFactor * sumMeasured + y;
+    sumNominalSquared = forgettingFactor * sumNominalSquared + x * x;
+    sumNominalMeasured = forgettingFactor * sumNominalMeasured + x * y;
+    
+    numRuns++;
+}
+
+
+bool DriftEstimator::isReady() const {
+    // The standard error of the slope is the measurement error divided by the root of the spread.
+    // With a single nominal duration the spread is zero, and any constant bias in the measurements
+    // would be mistaken for drift.
+    return (numRuns >= minRuns &&
+            measurementError * measurementError <= maxRatioError * maxRatioError * nominalSpread());
+}
+
+
+double DriftEstimator::getRatio() const {
+    const double spread = nominalSpread();
+    if (!(spread > 0.0)) {
+        return 1.0;
+    }
+    return (sumNominalMeasured - sumNominal * sumMeasured / sumWeights) / spread;
+}
+
+
+double DriftEstimator::nominalSpread() const {
+    if (sumWeights <= 0.0) {
+        return 0.0;
+    }
+    return std::max(0.0, sumNominalSquared - sumNominal * sumNominal / sumWeights);
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,58 @@
+//
+//  BlackrockLEDDriverDriftEstimator.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverDriftEstimator_hpp
+#define BlackrockLEDDriverDriftEstimator_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Online estimate of the rate of the driver's tick clock relative to the MWorks clock.  Fits
+//
+//   measured duration = ratio × nominal duration + offset
+//
+// by weighted least squares, where the nominal duration counts driver ticks and the measured one is
+// in host time.  The ratio is the slope of the fit, so it can be told apart from the offset (which
+// absorbs any constant bias in how run start and stop times are measured) only when runs have
+// different nominal durations.  The estimate isn't ready until the spread of durations pins down
+// the slope.
+//
+class DriftEstimator {
+    
+public:
+    DriftEstimator();
+    
+    void addRun(MWTime nominalDuration, MWTime measuredDuration);
+    
+    bool isReady() const;
+    std::size_t getNumRuns() const { return numRuns; }
+    double getRatio() const;
+    
+private:
+    static constexpr std::size_t minRuns = 3;
+    
+    // Exponentially weighted sums over runs, with durations in seconds
+    std::size_t numRuns;
+    double sumWeights;
+    double sumNominal;
+    double sumMeasured;
+    double sumNominalSquared;
+    double sumNominalMeasured;
+    
+    double nominalSpread() const;  // Weighted sum of squared deviations of nominal durations
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverDriftEstimator_hpp */
@@ -0,0 +1,80 @@
+//
+//  BlackrockLEDDriverIntensityInput.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverIntensityInput.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+BOOST_STATIC_ASSERT(std::is_standard_layout<IntensityInputLayout>::value);
+
+
+// A controller updating at hundreds of Hz almost never collides with a read, so a handful of
+// attempts is plenty
+constexpr std::size_t maxReadAttempts = 16;
+
+
+static IntensityInputLayout& createPage(MappedFile &file) {
+    // A controller may still have a valid page mapped from a previous experiment.  Leave it in place,
+    // so that the controller's mapping and sequence counter remain usable.
+    auto &existing = *static_cast<IntensityInputLayout *>(file.data());
+    if (file.isPreserved() &&
+        existing.magic == IntensityInputLayout::magicNumber &&
+        existing.version == IntensityInputLayout::currentVersion)
+    {
+        return existing;
+    }
+    
+    auto &page = *(new (file.data()) IntensityInputLayout());
+    page.magic = IntensityInputLayout::magicNumber;
+    page.version = IntensityInputLayout::currentVersion;
+    return page;
+}
+
+
+IntensityInput::IntensityInput(const std::string &path) :
+    file(path, sizeof(Layout)),
+    page(createPage(file)),
+    lastVersion(page.sequence.current())
+{ }
+
+
+bool IntensityInput::read(std::array<WordValue, numChannels> &words, std::array<BYTE, numChannels> &mask) {
+    // Checking for a change costs a single atomic load
+    if (page.sequence.current() == lastVersion) {
+        return false;
+    }
+    
+    std::array<std::uint16_t, numChannels> intensity;
+    std::array<std::uint8_t, numChannels> controlled;
+    std::uint64_t version;
+    
+    if (!page.sequence.read([&]() {
+            intensity = page.intensity;
+            controlled = page.mask;
+        },
+        version,
+        maxReadAttempts))
+    {
+        mwarning(M_IODEVICE_MESSAGE_DOMAIN,
+                 "LED driver intensity input is being updated too often to read; using previous intensities");
+        return false;
+    }
+    
+    for (std::size_t i = 0; i < numChannels; i++) {
+        mask[i] = (controlled[i] != 0);
+        words[i] = (mask[i] ? WORD(intensity[i]) : WORD(words[i]));
+    }
+    
+    lastVersion = version;
+    
+    return true;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
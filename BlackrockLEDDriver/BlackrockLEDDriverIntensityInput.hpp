@@ -0,0 +1,68 @@
+//
+//  BlackrockLEDDriverIntensityInput.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverIntensityInput_hpp
+#define BlackrockLEDDriverIntensityInput_hpp
+
+#include "BlackrockLEDDriverSharedMemory.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Channel intensities published by an external controller in a memory-mapped file.  All fields are
+// in host byte order.  The device creates the file and sets magic and version; the controller is
+// the sole writer of everything else, and must follow the SeqLock protocol, with the same memory
+// ordering as SeqLock::write:
+//
+//   atomic_store_explicit(&sequence, s + 1, memory_order_relaxed);  // Now odd
+//   atomic_thread_fence(memory_order_release);
+//   ... write intensity and mask ...
+//   atomic_store_explicit(&sequence, s + 2, memory_order_release);
+//
+// Without the fence and the release store, the device can see the new counter value before the
+// data it guards.  If the file already holds a valid page when the device opens it, the page
+// (including any intensities the controller published earlier) is left in place, but only updates
+// published after the device opens it are applied.
+//
+struct IntensityInputLayout {
+    static constexpr std::uint32_t magicNumber = 0x49444C42;  // "BLDI" in little-endian byte order
+    static constexpr std::uint32_t currentVersion = 1;
+    
+    std::uint32_t magic;
+    std::uint32_t version;
+    SeqLock sequence;
+    std::array<std::uint16_t, numChannels> intensity;  // Drive words (0-65535)
+    std::array<std::uint8_t, numChannels> mask;        // Non-zero for each channel the controller sets
+};
+
+
+class IntensityInput : boost::noncopyable {
+    
+public:
+    using Layout = IntensityInputLayout;
+    
+    explicit IntensityInput(const std::string &path);
+    
+    // If the controller has published since the last successful call, stores its intensities in
+    // words, sets mask to the channels it controls, and returns true.  Otherwise, returns false
+    // without touching either.
+    bool read(std::array<WordValue, numChannels> &words, std::array<BYTE, numChannels> &mask);
+    
+private:
+    MappedFile file;
+    const Layout &page;
+    std::uint64_t lastVersion;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverIntensityInput_hpp */
@@ -0,0 +1,152 @@
+//
+//  BlackrockLEDDriverLayout.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverLayout.hpp"
+
+#include <fstream>
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+ChannelLayout::ChannelLayout(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "Cannot open LED driver layout file", path);
+    }
+    
+    x.fill(0.0f);
+    y.fill(0.0f);
+    mapped.fill(0);
+    
+    std::string line;
+    std::size_t lineNumber = 0;
+    
+    while (std::getline(file, line)) {
+        lineNumber++;
+        
+        line = line.substr(0, line.find('#'));
+        std::replace(line.begin(), line.end(), ',', ' ');
+        boost::algorithm::trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        
+        std::istringstream is(line);
+        int channelNum;
+        double channelX, channelY;
+        if (!(is >> channelNum >> channelX >> channelY) || !(is >> std::ws).eof()) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("Invalid entry in LED driver layout file (line %d)")
+                                   % lineNumber).str(),
+                                  path);
+        }
+        
+        if (channelNum < 1 || std::size_t(channelNum) > numChannels) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("Invalid LED driver channel number in layout file (line %d)")
+                                   % lineNumber).str(),
+                                  path);
+        }
+        
+        if (mapped[channelNum - 1]) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver layout file lists channel %d more than once (line %d)")
+                                   % channelNum
+                                   % lineNumber).str(),
+                                  path);
+        }
+        
+        x[channelNum - 1] = channelX;
+        y[channelNum - 1] = channelY;
+        mapped[channelNum - 1] = 1;
+    }
+    
+    if (std::find(mapped.begin(), mapped.end(), 1) == mapped.end()) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "LED driver layout file contains no channels", path);
+    }
+}
+
+
+std::string ChannelLayout::rasterize(const PatternSpec &spec, std::array<WordValue, numChannels> &words) const {
+    if (spec.value < 0.0 || spec.value > 1.0) {
+        return "LED driver pattern intensity must be between 0 and 1";
+    }
+    if (spec.shape != PatternSpec::Shape::Image && spec.size <= 0.0) {
+        return "LED driver pattern size must be greater than zero";
+    }
+    
+    const float centerX = spec.centerX;
+    const float centerY = spec.centerY;
+    const float size = spec.size;
+    const float value = spec.value;
+    const float cosAngle = std::cos(spec.angle * M_PI / 180.0);
+    const float sinAngle = std::sin(spec.angle * M_PI / 180.0);
+    
+    std::array<float, numChannels> level;
+    
+    switch (spec.shape) {
+        case PatternSpec::Shape::Spot:
+            for (std::size_t i = 0; i < numChannels; i++) {
+                const float dx = x[i] - centerX;
+                const float dy = y[i] - centerY;
+                level[i] = (dx * dx + dy * dy <= size * size ? value : 0.0f);
+            }
+            break;
+            
+        case PatternSpec::Shape::Bar:
+            for (std::size_t i = 0; i < numChannels; i++) {
+                // Distance from the bar's center line
+                const float distance = std::abs((y[i] - centerY) * cosAngle - (x[i] - centerX) * sinAngle);
+                level[i] = (distance <= 0.5f * size ? value : 0.0f);
+            }
+            break;
+            
+        case PatternSpec::Shape::Gradient:
+            for (std::size_t i = 0; i < numChannels; i++) {
+                // Ramp from zero at the center to full intensity at distance size along the angle
+                const float distance = (x[i] - centerX) * cosAngle + (y[i] - centerY) * sinAngle;
+                level[i] = value * std::min(std::max(distance / size, 0.0f), 1.0f);
+            }
+            break;
+            
+        case PatternSpec::Shape::Image:
+            for (const auto &row : spec.image) {
+                for (double pixel : row) {
+                    if (pixel < 0.0 || pixel > 1.0) {
+                        return "LED driver pattern image values must be between 0 and 1";
+                    }
+                }
+            }
+            for (std::size_t i = 0; i < numChannels; i++) {
+                // Each channel takes the pixel nearest its position relative to the image origin
+                const long row = std::lround(y[i] - centerY);
+                const long column = std::lround(x[i] - centerX);
+                level[i] = 0.0f;
+                if (row >= 0 && row < long(spec.image.size()) &&
+                    column >= 0 && column < long(spec.image[row].size()))
+                {
+                    level[i] = value * float(spec.image[row][column]);
+                }
+            }
+            break;
+    }
+    
+    std::array<WORD, numChannels> levelWords;
+    for (std::size_t i = 0; i < numChannels; i++) {
+        levelWords[i] = WORD(level[i] * float(std::numeric_limits<WORD>::max()) + 0.5f);
+    }
+    
+    for (std::size_t i = 0; i < numChannels; i++) {
+        words[i] = (mapped[i] ? levelWords[i] : WORD(words[i]));
+    }
+    
+    return std::string();
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,56 @@
+//
+//  BlackrockLEDDriverLayout.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverLayout_hpp
+#define BlackrockLEDDriverLayout_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+struct PatternSpec {
+    enum class Shape { Spot, Bar, Gradient, Image };
+    
+    Shape shape = Shape::Spot;
+    double centerX = 0.0;
+    double centerY = 0.0;
+    double size = 0.0;   // Spot radius, bar width, or gradient length
+    double angle = 0.0;  // Degrees counterclockwise from the x axis
+    double value = 1.0;  // Peak intensity
+    std::vector<std::vector<double>> image;  // Rows of intensities, indexed by [y][x]
+};
+
+
+//
+// Physical position of each channel in the array, loaded from a text file
+//
+class ChannelLayout : boost::noncopyable {
+    
+public:
+    explicit ChannelLayout(const std::string &path);
+    
+    const std::array<BYTE, numChannels>& getMask() const { return mapped; }
+    
+    // Computes the pattern's intensity at every mapped channel and stores it in words, leaving
+    // unmapped channels unchanged.  Returns an empty string on success, or a description of the
+    // problem if the pattern is invalid.
+    std::string rasterize(const PatternSpec &spec, std::array<WordValue, numChannels> &words) const;
+    
+private:
+    std::array<float, numChannels> x;
+    std::array<float, numChannels> y;
+    std::array<BYTE, numChannels> mapped;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverLayout_hpp */
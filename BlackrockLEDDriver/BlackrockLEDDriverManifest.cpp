@@ -0,0 +1,72 @@
+//
+//  BlackrockLEDDriverManifest.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverManifest.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+template<typename T>
+static void appendLittleEndian(std::string &record, T value) {
+    const auto bits = static_cast<std::uint64_t>(value);
+    for (std::size_t i = 0; i < sizeof(T); i++) {
+        record.push_back(char((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+
+std::string RunManifestEncoder::encode(MWTime startTime,
+                                       MWTime stopTime,
+                                       MWTime samplePeriod,
+                                       std::size_t samplesUsed,
+                                       const std::array<WordValue, numChannels> &intensity,
+                                       const std::vector<std::uint64_t> &sampleMasks)
+{
+    std::uint64_t hash = 0xCBF29CE484222325;
+    for (WORD word : intensity) {
+        for (BYTE byte : { BYTE(word & 0xFF), BYTE(word >> 8) }) {
+            hash = (hash ^ byte) * 0x100000001B3;
+        }
+    }
+    
+    BYTE flags = 0;
+    if (reportedIntensities.insert(hash).second) {
+        flags |= intensitiesIncluded;
+    }
+    if (!sampleMasks.empty()) {
+        flags |= sampleMasksIncluded;
+    }
+    
+    std::string record;
+    record.reserve(40 + numChannels * sizeof(WORD) + sampleMasks.size() * sizeof(std::uint64_t));
+    
+    appendLittleEndian<BYTE>(record, version);
+    appendLittleEndian<BYTE>(record, flags);
+    appendLittleEndian<BYTE>(record, samplesUsed);
+    appendLittleEndian<BYTE>(record, 0);
+    appendLittleEndian<std::uint32_t>(record, samplePeriod);
+    appendLittleEndian<std::int64_t>(record, startTime);
+    appendLittleEndian<std::int64_t>(record, stopTime);
+    appendLittleEndian<std::int64_t>(record, MWTime(numSamples - samplesUsed) * samplePeriod);
+    appendLittleEndian<std::uint64_t>(record, hash);
+    
+    if (flags & intensitiesIncluded) {
+        for (WORD word : intensity) {
+            appendLittleEndian<WORD>(record, word);
+        }
+    }
+    
+    for (auto mask : sampleMasks) {
+        appendLittleEndian<std::uint64_t>(record, mask);
+    }
+    
+    return record;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,65 @@
+//
+//  BlackrockLEDDriverManifest.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverManifest_hpp
+#define BlackrockLEDDriverManifest_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Each run manifest is a byte string with the following layout (all fields little-endian):
+//
+//   version (1 byte, currently 1)
+//   flags (1 byte: bit 0 = intensities included, bit 1 = sample masks included)
+//   samples used (1 byte)
+//   reserved (1 byte, zero)
+//   sample period in microseconds (4 bytes, unsigned)
+//   start time (8 bytes, signed, MWorks time in microseconds)
+//   stop time (8 bytes, signed, MWorks time in microseconds)
+//   padding after the last used sample, in microseconds (8 bytes, signed)
+//   FNV-1a hash of the intensities (8 bytes)
+//   intensities (64 x 2 bytes, if flag bit 0 is set)
+//   sample masks (samples used x 8 bytes, if flag bit 1 is set; bit N = channel N+1 is on)
+//
+// Intensities are included only the first time a given set is reported.  Later manifests carry
+// only the hash, which matches that of the earlier manifest.  The encoder forgets which sets it has
+// reported whenever the experiment stops, so a data file opened before the experiment starts
+// running holds every set its manifests refer to.  (A data file opened while the experiment is
+// running may not.)  Sample masks are present only for pulse trains; otherwise, every channel is on
+// for all used samples.
+//
+class RunManifestEncoder {
+    
+public:
+    static constexpr BYTE version = 1;
+    static constexpr BYTE intensitiesIncluded = 1 << 0;
+    static constexpr BYTE sampleMasksIncluded = 1 << 1;
+    
+    std::string encode(MWTime startTime,
+                       MWTime stopTime,
+                       MWTime samplePeriod,
+                       std::size_t samplesUsed,
+                       const std::array<WordValue, numChannels> &intensity,
+                       const std::vector<std::uint64_t> &sampleMasks);
+                       
+    // Forgets which intensities have been reported, so the next manifest for each set includes it
+    void reset() { reportedIntensities.clear(); }
+    
+private:
+    std::set<std::uint64_t> reportedIntensities;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverManifest_hpp */
@@ -8,9 +8,14 @@
 
 #include "BlackrockLEDDriverDevice.h"
 #include "BlackrockLEDDriverSetIntensityAction.h"
+#include "BlackrockLEDDriverSetPowerAction.hpp"
+#include "BlackrockLEDDriverSetPatternAction.hpp"
 #include "BlackrockLEDDriverPrepareAction.hpp"
 #include "BlackrockLEDDriverRunAction.h"
+#include "BlackrockLEDDriverQueueRunAction.hpp"
+#include "BlackrockLEDDriverRunPulseTrainAction.hpp"
 #include "BlackrockLEDDriverStopAction.hpp"
+#include "BlackrockLEDDriverAbortAction.hpp"
 #include "BlackrockLEDDriverReadTempsAction.hpp"
 
 
@@ -21,9 +26,14 @@ class Plugin : public mw::Plugin {
     void registerComponents(boost::shared_ptr<ComponentRegistry> registry) override {
         registry->registerFactory<StandardComponentFactory, Device>();
         registry->registerFactory<StandardComponentFactory, SetIntensityAction>();
+        registry->registerFactory<StandardComponentFactory, SetPowerAction>();
+        registry->registerFactory<StandardComponentFactory, SetPatternAction>();
         registry->registerFactory<StandardComponentFactory, PrepareAction>();
         registry->registerFactory<StandardComponentFactory, RunAction>();
+        registry->registerFactory<StandardComponentFactory, QueueRunAction>();
+        registry->registerFactory<StandardComponentFactory, RunPulseTrainAction>();
         registry->registerFactory<StandardComponentFactory, StopAction>();
+        registry->registerFactory<StandardComponentFactory, AbortAction>();
         registry->registerFactory<StandardComponentFactory, ReadTempsAction>();
     }
 };
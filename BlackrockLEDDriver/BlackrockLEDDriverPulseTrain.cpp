@@ -0,0 +1,130 @@
+//
+//  BlackrockLEDDriverPulseTrain.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverPulseTrain.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Lays out the train using the given period.  Returns false if any pulse vanishes, merges with the
+// next one, or extends past the end of the file.
+//
+static bool layOutPulseTrain(const PulseTrainSpec &spec, MWTime normPeriod, PulseTrainEncoding &encoding) {
+    const double samplePeriod = double(normPeriod * periodIncrement);
+    const double pulseInterval = 1e6 / spec.frequency;
+    
+    encoding.period = normPeriod;
+    encoding.samplesUsed = 0;
+    encoding.maxTimingError = 0;
+    for (auto &sample : encoding.on) {
+        sample.fill(0);
+    }
+    
+    double maxTimingError = 0.0;
+    
+    for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+        if (!spec.channels[channelIndex]) {
+            continue;
+        }
+        
+        long long previousEnd = -1;
+        
+        for (std::size_t pulse = 0; pulse < spec.pulseCount; pulse++) {
+            const double start = double(spec.phaseOffset[channelIndex]) + double(pulse) * pulseInterval;
+            const double end = start + double(spec.pulseWidth);
+            const long long startSample = std::llround(start / samplePeriod);
+            const long long endSample = std::llround(end / samplePeriod);
+            
+            if (endSample <= startSample || startSample <= previousEnd || std::size_t(endSample) > numSamples) {
+                return false;
+            }
+            
+            maxTimingError = std::max({ maxTimingError,
+                                        std::abs(double(startSample) * samplePeriod - start),
+                                        std::abs(double(endSample) * samplePeriod - end) });
+            
+            for (long long sample = startSample; sample < endSample; sample++) {
+                encoding.on[sample][channelIndex] = 1;
+            }
+            encoding.samplesUsed = std::max(encoding.samplesUsed, std::size_t(endSample));
+            previousEnd = endSample;
+        }
+    }
+    
+    encoding.maxTimingError = MWTime(std::llround(maxTimingError));
+    
+    return true;
+}
+
+
+std::string compilePulseTrain(const PulseTrainSpec &spec, PulseTrainEncoding &encoding) {
+    if (spec.frequency <= 0.0) {
+        return "LED driver pulse train frequency must be greater than zero";
+    }
+    if (spec.pulseWidth <= 0) {
+        return "LED driver pulse width must be greater than zero";
+    }
+    if (spec.pulseCount < 1) {
+        return "LED driver pulse train must contain at least one pulse";
+    }
+    if (spec.pulseCount > 1 && double(spec.pulseWidth) >= 1e6 / spec.frequency) {
+        return "LED driver pulse width must be less than the interval between pulses";
+    }
+    
+    double trainLength = 0.0;
+    for (std::size_t channelIndex = 0; channelIndex < numChannels; channelIndex++) {
+        if (spec.channels[channelIndex]) {
+            if (spec.phaseOffset[channelIndex] < 0) {
+                return "LED driver pulse train phase offsets must be non-negative";
+            }
+            trainLength = std::max(trainLength,
+                                   (double(spec.phaseOffset[channelIndex]) +
+                                    double(spec.pulseCount - 1) * 1e6 / spec.frequency +
+                                    double(spec.pulseWidth)));
+        }
+    }
+    if (trainLength == 0.0) {
+        return "LED driver pulse train must include at least one channel";
+    }
+    
+    // Shorter periods can't fit the train in the file, and longer ones would round the pulses away
+    const double maxSamplePeriod = 2.0 * double(spec.pulseWidth);
+    const MWTime normPeriodMin = std::max(MWTime(1), MWTime(trainLength / double(numSamples * periodIncrement)));
+    const MWTime normPeriodMax = std::min(MWTime(maxSamplePeriod / double(periodIncrement)),
+                                          MWTime(std::numeric_limits<WORD>::max()));
+    
+    bool found = false;
+    PulseTrainEncoding candidate;
+    
+    for (MWTime normPeriod = normPeriodMin; normPeriod <= normPeriodMax; normPeriod++) {
+        if (layOutPulseTrain(spec, normPeriod, candidate) &&
+            (!found || candidate.maxTimingError < encoding.maxTimingError))
+        {
+            encoding = candidate;
+            found = true;
+            if (encoding.maxTimingError == 0) {
+                break;
+            }
+        }
+    }
+    
+    if (!found) {
+        return (boost::format("LED driver pulse train (%g ms long, with %g ms pulses) cannot be encoded in %d "
+                              "samples of a multiple of %g ms")
+                % (trainLength / 1e3)
+                % (double(spec.pulseWidth) / 1e3)
+                % numSamples
+                % (double(periodIncrement) / 1e3)).str();
+    }
+    
+    return std::string();
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
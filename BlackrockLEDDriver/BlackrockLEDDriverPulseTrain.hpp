@@ -0,0 +1,45 @@
+//
+//  BlackrockLEDDriverPulseTrain.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverPulseTrain_hpp
+#define BlackrockLEDDriverPulseTrain_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+struct PulseTrainSpec {
+    double frequency = 0.0;  // Hz
+    MWTime pulseWidth = 0;
+    std::size_t pulseCount = 0;
+    std::array<BYTE, numChannels> channels {};       // Non-zero for each channel that pulses
+    std::array<MWTime, numChannels> phaseOffset {};  // Start of each channel's first pulse
+};
+
+
+struct PulseTrainEncoding {
+    WORD period;  // In units of periodIncrement
+    std::size_t samplesUsed;
+    std::array<std::array<BYTE, numChannels>, numSamples> on;
+    MWTime maxTimingError;  // Largest difference between a requested and an encoded pulse edge
+};
+
+
+//
+// Searches the allowed periods for the one that places every pulse edge closest to its requested
+// time, preferring the shortest period among equally good ones.  Returns an empty string on
+// success, or a description of the problem if the train cannot be encoded in a single file.
+//
+std::string compilePulseTrain(const PulseTrainSpec &spec, PulseTrainEncoding &encoding);
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverPulseTrain_hpp */
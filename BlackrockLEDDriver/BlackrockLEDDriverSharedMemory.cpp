@@ -0,0 +1,54 @@
+//
+//  BlackrockLEDDriverSharedMemory.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverSharedMemory.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+MappedFile::MappedFile(const std::string &path, std::size_t size) :
+    size(size),
+    fd(-1),
+    address(MAP_FAILED),
+    preserved(false)
+{
+    if (-1 == (fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644))) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("Cannot open shared memory file: %s") % strerror(errno)).str(),
+                              path);
+    }
+    
+    struct stat info;
+    if (-1 != ::fstat(fd, &info)) {
+        preserved = (off_t(size) == info.st_size);
+    }
+    
+    if ((!preserved && -1 == ::ftruncate(fd, size)) ||
+        MAP_FAILED == (address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)))
+    {
+        const int error = errno;
+        ::close(fd);
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                              (boost::format("Cannot map shared memory file: %s") % strerror(error)).str(),
+                              path);
+    }
+}
+
+
+MappedFile::~MappedFile() {
+    ::munmap(address, size);
+    ::close(fd);
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
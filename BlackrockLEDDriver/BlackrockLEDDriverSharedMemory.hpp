@@ -0,0 +1,97 @@
+//
+//  BlackrockLEDDriverSharedMemory.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverSharedMemory_hpp
+#define BlackrockLEDDriverSharedMemory_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// File mapped into memory and shared with other local processes.  The file is created if necessary
+// and resized to the given size.  It is never truncated, because another process that has it mapped
+// would crash on its next access to the page.  If the file already has the given size, its contents
+// are preserved.
+//
+class MappedFile : boost::noncopyable {
+    
+public:
+    MappedFile(const std::string &path, std::size_t size);
+    ~MappedFile();
+    
+    void* data() const { return address; }
+    
+    // True if the file already existed with the given size
+    bool isPreserved() const { return preserved; }
+    
+private:
+    const std::size_t size;
+    int fd;
+    void *address;
+    bool preserved;
+    
+};
+
+
+//
+// Sequence counter guarding data in shared memory.  There must be only one writer (which may be in
+// another process), but any number of readers can run concurrently with it, without locking.  The
+// counter is odd while a write is in progress; a reader that sees it odd, or sees it change while
+// reading, must retry.
+//
+class SeqLock {
+    
+public:
+    SeqLock() : sequence(0) { }
+    
+    template<typename Function>
+    void write(Function &&function) {
+        const auto current = sequence.load(std::memory_order_relaxed);
+        sequence.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        function();
+        sequence.store(current + 2, std::memory_order_release);
+    }
+    
+    // Even values identify completed writes, so readers can compare them to detect changes
+    std::uint64_t current() const {
+        return sequence.load(std::memory_order_acquire);
+    }
+    
+    // Calls function until it runs without overlapping a write, up to maxAttempts times.  On
+    // success, stores the sequence value that function observed in version.
+    template<typename Function>
+    bool read(Function &&function, std::uint64_t &version, std::size_t maxAttempts) const {
+        for (std::size_t attempt = 0; attempt < maxAttempts; attempt++) {
+            const auto start = sequence.load(std::memory_order_acquire);
+            if (start & 1) {
+                continue;
+            }
+            function();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == start) {
+                version = start;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+private:
+    std::atomic<std::uint64_t> sequence;
+    BOOST_STATIC_ASSERT(sizeof(sequence) == sizeof(std::uint64_t));
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverSharedMemory_hpp */
@@ -0,0 +1,31 @@
+//
+//  BlackrockLEDDriverStatusPage.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverStatusPage.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+BOOST_STATIC_ASSERT(std::is_standard_layout<StatusPageLayout>::value);
+BOOST_STATIC_ASSERT(Protocol::size() <= std::tuple_size<decltype(StatusPageLayout::commandCodes)>::value);
+
+
+StatusPage::StatusPage(const std::string &path) :
+    file(path, sizeof(Layout)),
+    page(*(new (file.data()) Layout()))
+{
+    page.magic = Layout::magicNumber;
+    page.version = Layout::currentVersion;
+    
+    // Unused command slots have code zero
+    const auto codes = Protocol::codes();
+    std::copy(codes.begin(), codes.end(), page.commandCodes.begin());
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,74 @@
+//
+//  BlackrockLEDDriverStatusPage.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverStatusPage_hpp
+#define BlackrockLEDDriverStatusPage_hpp
+
+#include "BlackrockLEDDriverSharedMemory.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Driver status, published in a memory-mapped file for external monitors.  All fields are in host
+// byte order.  Readers must follow the SeqLock protocol: read sequence, copy the page, then re-read
+// sequence, retrying if it was odd or changed.
+//
+struct StatusPageLayout {
+    static constexpr std::uint32_t magicNumber = 0x53444C42;  // "BLDS" in little-endian byte order
+    static constexpr std::uint32_t currentVersion = 1;
+    static constexpr std::size_t numTemps = 4;
+    
+    struct CommandStats {
+        std::uint64_t count;
+        std::uint64_t errors;
+        std::uint64_t totalLatency;  // Microseconds
+        std::uint64_t maxLatency;    // Microseconds
+    };
+    
+    std::uint32_t magic;
+    std::uint32_t version;
+    SeqLock sequence;
+    std::int64_t updateTime;  // MWorks time (microseconds) of the most recent update
+    std::uint32_t running;
+    std::uint32_t samplesUsed;
+    std::int64_t samplePeriod;  // Microseconds
+    std::array<std::uint16_t, numChannels> intensity;
+    std::array<double, numTemps> temps;
+    std::array<std::uint8_t, 8> commandCodes;
+    std::array<CommandStats, 8> commands;
+};
+
+
+class StatusPage : boost::noncopyable {
+    
+public:
+    using Layout = StatusPageLayout;
+    
+    explicit StatusPage(const std::string &path);
+    
+    // Calls function with the page, as a single atomic (to readers) update
+    template<typename Function>
+    void update(MWTime currentTime, Function &&function) {
+        page.sequence.write([&]() {
+            page.updateTime = currentTime;
+            function(page);
+        });
+    }
+    
+private:
+    MappedFile file;
+    Layout &page;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverStatusPage_hpp */
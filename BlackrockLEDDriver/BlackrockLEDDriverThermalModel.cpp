@@ -0,0 +1,143 @@
+//
+//  BlackrockLEDDriverThermalModel.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverThermalModel.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+// Assumed ambient temperature, until the first thermistor reading for a bank
+constexpr double defaultAmbient = 25.0;  // °C
+
+// Readings taken while a bank's heat is below this level update its ambient temperature; readings
+// taken above it update its gain
+constexpr double minCalibrationHeat = 0.25;
+
+// Fraction of the difference between observed and modeled gain applied per reading
+constexpr double gainAdaptationRate = 0.2;
+
+
+ThermalModel::ThermalModel(MWTime timeConstant, double initialGain) :
+    timeConstant(double(timeConstant)),
+    stateTime(0),
+    loadEndTime(0)
+{
+    banks.fill({ defaultAmbient, initialGain, 0.0, 0.0 });
+    ambientMeasured.fill(false);
+}
+
+
+auto ThermalModel::predictRun(MWTime startTime,
+                              MWTime duration,
+                              const std::array<WordValue, numChannels> &intensity) const -> Temperatures
+{
+    const auto loads = bankLoads(intensity);
+    Temperatures peak;
+    
+    for (std::size_t i = 0; i < numBanks; i++) {
+        const auto &bank = banks[i];
+        const double startHeat = heatAt(bank, startTime);
+        
+        // With constant input, heat moves monotonically toward the load, so the peak is at either
+        // the start or the end of the run
+        const double endHeat = relax(startHeat, loads[i], duration);
+        peak[i] = bank.ambient + bank.gain * std::max(startHeat, endHeat);
+    }
+    
+    return peak;
+}
+
+
+void ThermalModel::addRun(MWTime startTime,
+                          MWTime duration,
+                          const std::array<WordValue, numChannels> &intensity)
+{
+    advance(startTime);
+    
+    const auto loads = bankLoads(intensity);
+    for (std::size_t i = 0; i < numBanks; i++) {
+        banks[i].load = loads[i];
+    }
+    loadEndTime = startTime + duration;
+}
+
+
+void ThermalModel::endRun(MWTime stopTime) {
+    if (stopTime < loadEndTime) {
+        advance(stopTime);
+        loadEndTime = stopTime;
+        for (auto &bank : banks) {
+            bank.load = 0.0;
+        }
+    }
+}
+
+
+void ThermalModel::addReading(std::size_t bankIndex, double temperature, MWTime time) {
+    advance(time);
+    
+    auto &bank = banks[bankIndex];
+    
+    if (!ambientMeasured[bankIndex] || bank.heat < minCalibrationHeat) {
+        bank.ambient = temperature - bank.gain * bank.heat;
+        ambientMeasured[bankIndex] = true;
+    } else {
+        const double observedGain = std::max(0.0, (temperature - bank.ambient) / bank.heat);
+        bank.gain += gainAdaptationRate * (observedGain - bank.gain);
+    }
+}
+
+
+auto ThermalModel::bankLoads(const std::array<WordValue, numChannels> &intensity) -> std::array<double, numBanks> {
+    std::array<double, numBanks> loads;
+    loads.fill(0.0);
+    
+    for (std::size_t i = 0; i < numChannels; i++) {
+        loads[i / channelsPerBank] += double(WORD(intensity[i])) / double(std::numeric_limits<WORD>::max());
+    }
+    
+    return loads;
+}
+
+
+double ThermalModel::relax(double heat, double load, MWTime interval) const {
+    if (interval <= 0) {
+        return heat;
+    }
+    return load + (heat - load) * std::exp(-double(interval) / timeConstant);
+}
+
+
+double ThermalModel::heatAt(const Bank &bank, MWTime time) const {
+    if (time <= loadEndTime) {
+        return relax(bank.heat, bank.load, time - stateTime);
+    }
+    
+    // Heat with the current load until the end of the run, then cool with no input
+    const MWTime loadInterval = loadEndTime - stateTime;
+    const double endHeat = relax(bank.heat, bank.load, loadInterval);
+    return relax(endHeat, 0.0, time - std::max(loadEndTime, stateTime));
+}
+
+
+void ThermalModel::advance(MWTime time) {
+    if (time <= stateTime) {
+        return;
+    }
+    
+    for (auto &bank : banks) {
+        bank.heat = heatAt(bank, time);
+        if (time >= loadEndTime) {
+            bank.load = 0.0;
+        }
+    }
+    stateTime = time;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,71 @@
+//
+//  BlackrockLEDDriverThermalModel.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverThermalModel_hpp
+#define BlackrockLEDDriverThermalModel_hpp
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// First-order (single RC) thermal model of the LED array.  Each of the four thermistor banks covers
+// 16 consecutive channels.  A bank's heat input is the sum of its channels' intensities, and its
+// temperature relaxes toward ambient + gain × input with the given time constant.  Thermistor
+// readings refine each bank's ambient temperature (when the bank is cool) and gain (when it is warm).
+//
+class ThermalModel : boost::noncopyable {
+    
+public:
+    static constexpr std::size_t numBanks = 4;
+    static constexpr std::size_t channelsPerBank = numChannels / numBanks;
+    
+    using Temperatures = std::array<double, numBanks>;
+    
+    ThermalModel(MWTime timeConstant, double initialGain);
+    
+    MWTime getTimeConstant() const { return MWTime(timeConstant); }
+    
+    // Predicted peak temperature of each bank if a run with the given intensities starts at startTime
+    Temperatures predictRun(MWTime startTime,
+                            MWTime duration,
+                            const std::array<WordValue, numChannels> &intensity) const;
+    
+    void addRun(MWTime startTime, MWTime duration, const std::array<WordValue, numChannels> &intensity);
+    void endRun(MWTime stopTime);
+    void addReading(std::size_t bankIndex, double temperature, MWTime time);
+    
+private:
+    struct Bank {
+        double ambient;
+        double gain;
+        double heat;  // Temperature rise above ambient, divided by gain
+        double load;  // Heat input while a run is active
+    };
+    
+    static std::array<double, numBanks> bankLoads(const std::array<WordValue, numChannels> &intensity);
+    
+    double relax(double heat, double load, MWTime interval) const;
+    double heatAt(const Bank &bank, MWTime time) const;
+    void advance(MWTime time);
+    
+    const double timeConstant;
+    
+    std::array<Bank, numBanks> banks;
+    std::array<bool, numBanks> ambientMeasured;
+    MWTime stateTime;
+    MWTime loadEndTime;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverThermalModel_hpp */
@@ -0,0 +1,151 @@
+//
+//  BlackrockLEDDriverTrace.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverTrace.hpp"
+
+#include <fstream>
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+static std::atomic<std::uint64_t> nextRecorderID(1);
+
+
+TraceRecorder::TraceRecorder(const std::string &path, DeviceClock &clock) :
+    path(path),
+    clock(clock),
+    recorderID(nextRecorderID++)
+{
+    // Fail at load time, rather than when the trace is written
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "Cannot open LED driver trace file", path);
+    }
+}
+
+
+void TraceRecorder::recordSpan(const char *name, const char *category, MWTime startTime) {
+    push({ name, category, 'X', startTime, clock.getCurrentTimeUS() - startTime, 0.0 });
+}
+
+
+void TraceRecorder::recordCounter(const char *name, double value) {
+    push({ name, "state", 'C', clock.getCurrentTimeUS(), 0, value });
+}
+
+
+bool TraceRecorder::write() {
+    // Copy the rings first, so that the file is written without holding ringsMutex (which would
+    // block threads that record for the first time)
+    std::vector<Snapshot> snapshots;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        snapshots.resize(rings.size());
+        for (std::size_t i = 0; i < rings.size(); i++) {
+            snapshot(*(rings[i]), snapshots[i]);
+        }
+    }
+    
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\"traceEvents\":[";
+    
+    bool first = true;
+    std::size_t numEvents = 0;
+    
+    for (const auto &snapshot : snapshots) {
+        const int tid = int(snapshot.threadIndex) + 1;
+        
+        file << (first ? "" : ",")
+             << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << tid
+             << ",\"args\":{\"name\":\"LED driver thread " << tid << "\"}}";
+        first = false;
+        
+        for (const auto &event : snapshot.events) {
+            file << ",\n{\"ph\":\"" << event.phase
+                 << "\",\"name\":\"" << event.name
+                 << "\",\"cat\":\"" << event.category
+                 << "\",\"pid\":1,\"tid\":" << tid
+                 << ",\"ts\":" << event.timestamp;
+            if (event.phase == 'X') {
+                file << ",\"dur\":" << event.duration;
+            } else {
+                file << ",\"args\":{\"value\":" << event.value << "}";
+            }
+            file << "}";
+            
+            numEvents++;
+        }
+    }
+    
+    file << "\n]}\n";
+    file.close();
+    
+    if (!file) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot write LED driver trace file (%s)", path.c_str());
+        return false;
+    }
+    
+    mprintf(M_IODEVICE_MESSAGE_DOMAIN, "Wrote %lu LED driver trace events to %s", numEvents, path.c_str());
+    return true;
+}
+
+
+void TraceRecorder::snapshot(const Ring &ring, Snapshot &snapshot) {
+    snapshot.threadIndex = ring.threadIndex;
+    
+    // Events older than one ring's worth have been overwritten
+    const std::uint64_t head = ring.head.load(std::memory_order_acquire);
+    const std::uint64_t tail = (head > ringCapacity ? head - ringCapacity : 0);
+    
+    snapshot.events.reserve(head - tail);
+    for (std::uint64_t index = tail; index < head; index++) {
+        snapshot.events.push_back(ring.events[index % ringCapacity]);
+    }
+    
+    // The owning thread may have kept recording during the copy.  Once the write of event N has
+    // begun, the slot of event N - ringCapacity is no longer valid, so drop every event whose slot
+    // may have been reused.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const std::uint64_t started = ring.started.load(std::memory_order_relaxed);
+    const std::uint64_t firstValid = (started > ringCapacity ? started - ringCapacity : 0);
+    if (firstValid > tail) {
+        snapshot.events.erase(snapshot.events.begin(),
+                              snapshot.events.begin() + std::min(firstValid, head) - tail);
+    }
+}
+
+
+auto TraceRecorder::threadRing() -> Ring& {
+    // Each thread caches its ring for every recorder it has used.  Recorder IDs are never reused, so
+    // entries for destroyed recorders are simply never looked up again.
+    thread_local std::map<std::uint64_t, Ring *> threadRings;
+    
+    auto &ring = threadRings[recorderID];
+    if (!ring) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.emplace_back(new Ring(rings.size()));
+        ring = rings.back().get();
+    }
+    
+    return *ring;
+}
+
+
+void TraceRecorder::push(const Event &event) {
+    // Announce the write before overwriting the slot, as SeqLock does, so that a concurrent snapshot
+    // can tell which of the events it copied are intact
+    auto &ring = threadRing();
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    ring.started.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    ring.events[head % ringCapacity] = event;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,113 @@
+//
+//  BlackrockLEDDriverTrace.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverTrace_hpp
+#define BlackrockLEDDriverTrace_hpp
+
+#include "BlackrockLEDDriverClock.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+//
+// Records timed spans and counter values in per-thread ring buffers, and writes them as a Chrome
+// trace (JSON), which can be viewed in chrome://tracing or Perfetto.  Recording never blocks: each
+// thread writes only to its own ring, and the oldest events are overwritten when a ring is full.
+// Writing the trace takes a snapshot of each ring, discarding any event that was overwritten while it
+// was being copied.  Names and categories must be string literals.
+//
+class TraceRecorder : boost::noncopyable {
+    
+public:
+    static constexpr std::size_t ringCapacity = 8192;  // About 400 KB per thread
+    
+    TraceRecorder(const std::string &path, DeviceClock &clock);
+    
+    MWTime getCurrentTimeUS() { return clock.getCurrentTimeUS(); }
+    
+    void recordSpan(const char *name, const char *category, MWTime startTime);
+    void recordCounter(const char *name, double value);
+    
+    // Writes all events recorded so far, replacing the contents of the trace file
+    bool write();
+    
+private:
+    struct Event {
+        const char *name;
+        const char *category;
+        char phase;
+        MWTime timestamp;
+        MWTime duration;
+        double value;
+    };
+    
+    struct Ring {
+        explicit Ring(std::size_t threadIndex) :
+            threadIndex(threadIndex),
+            events(ringCapacity),
+            started(0),
+            head(0)
+        { }
+        
+        const std::size_t threadIndex;
+        std::vector<Event> events;
+        std::atomic<std::uint64_t> started;  // Number of events whose write has begun
+        std::atomic<std::uint64_t> head;     // Number of events whose write has completed
+    };
+    
+    struct Snapshot {
+        std::size_t threadIndex;
+        std::vector<Event> events;
+    };
+    
+    Ring& threadRing();
+    void push(const Event &event);
+    static void snapshot(const Ring &ring, Snapshot &snapshot);
+    
+    const std::string path;
+    DeviceClock &clock;
+    const std::uint64_t recorderID;
+    
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    
+};
+
+
+//
+// Records a span from construction to destruction.  Does nothing if recorder is null.
+//
+class TraceSpan : boost::noncopyable {
+    
+public:
+    TraceSpan(TraceRecorder *recorder, const char *name, const char *category) :
+        recorder(recorder),
+        name(name),
+        category(category),
+        startTime(recorder ? recorder->getCurrentTimeUS() : 0)
+    { }
+    
+    ~TraceSpan() {
+        if (recorder) {
+            recorder->recordSpan(name, category, startTime);
+        }
+    }
+    
+private:
+    TraceRecorder * const recorder;
+    const char * const name;
+    const char * const category;
+    const MWTime startTime;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverTrace_hpp */
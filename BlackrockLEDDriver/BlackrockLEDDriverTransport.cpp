@@ -0,0 +1,343 @@
+//
+//  BlackrockLEDDriverTransport.cpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#include "BlackrockLEDDriverTransport.hpp"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+bool FTDITransport::read(BYTE *data, std::size_t size) {
+    FT_STATUS status;
+    DWORD bytesRead;
+    
+    if (FT_OK != (status = FT_Read(handle, data, size, &bytesRead))) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Read from LED driver failed (status: %d)", status);
+        return false;
+    }
+    
+    if (bytesRead != size) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN,
+               "Incomplete read from LED driver (requested %lu bytes, read %d)",
+               size,
+               bytesRead);
+        return false;
+    }
+    
+    return true;
+}
+
+
+bool FTDITransport::write(const BYTE *data, std::size_t size) {
+    FT_STATUS status;
+    DWORD bytesWritten;
+    
+    if (FT_OK != (status = FT_Write(handle, const_cast<BYTE *>(data), size, &bytesWritten))) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Write to LED driver failed (status: %d)", status);
+        return false;
+    }
+    
+    if (bytesWritten != size) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN,
+               "Incomplete write to LED driver (attempted %lu bytes, wrote %d)",
+               size,
+               bytesWritten);
+        return false;
+    }
+    
+    return true;
+}
+
+
+void FTDITransport::purge() {
+    FT_STATUS status = FT_Purge(handle, FT_PURGE_RX);
+    if (FT_OK != status) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Cannot purge LED driver receive buffer (status: %d)", status);
+    }
+}
+
+
+CaptureTransport::CaptureTransport(std::unique_ptr<Transport> transport, const std::string &path) :
+    transport(std::move(transport)),
+    clock(Clock::instance()),
+    file(path, std::ios::binary | std::ios::trunc),
+    lastRecordTime(clock->getCurrentTimeUS())
+{
+    if (!file) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "Cannot open LED driver capture file", path);
+    }
+    file.write(captureFileMagic.data(), captureFileMagic.size());
+}
+
+
+CaptureTransport::~CaptureTransport() {
+    file.flush();
+    if (!file) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Write to LED driver capture file failed");
+    }
+}
+
+
+bool CaptureTransport::read(BYTE *data, std::size_t size) {
+    const bool success = transport->read(data, size);
+    record(CaptureDirection::Response, data, (success ? size : 0));
+    return success;
+}
+
+
+bool CaptureTransport::write(const BYTE *data, std::size_t size) {
+    record(CaptureDirection::Request, data, size);
+    return transport->write(data, size);
+}
+
+
+void CaptureTransport::record(CaptureDirection direction, const BYTE *data, std::size_t size) {
+    std::lock_guard<std::mutex> lock(fileMutex);
+    const MWTime currentTime = clock->getCurrentTimeUS();
+    
+    file.put(char(direction));
+    writeVarint(currentTime - lastRecordTime);
+    writeVarint(size);
+    file.write(reinterpret_cast<const char *>(data), size);
+    
+    lastRecordTime = currentTime;
+}
+
+
+void CaptureTransport::writeVarint(std::uint64_t value) {
+    do {
+        BYTE byte = value & 0x7F;
+        value >>= 7;
+        if (value) {
+            byte |= 0x80;
+        }
+        file.put(char(byte));
+    } while (value);
+}
+
+
+static bool readVarint(std::istream &file, std::uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const int byte = file.get();
+        if (byte == std::char_traits<char>::eof()) {
+            return false;
+        }
+        value |= std::uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+ReplayTransport::ReplayTransport(const std::string &path, bool originalTiming) :
+    originalTiming(originalTiming),
+    clock(Clock::instance()),
+    nextExchangeIndex(0),
+    filePlaying(0),
+    timeOffset(0)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "Cannot open LED driver capture file", path);
+    }
+    
+    std::array<char, captureFileMagic.size()> magic;
+    if (!file.read(magic.data(), magic.size()) || magic != captureFileMagic) {
+        throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "File is not an LED driver capture", path);
+    }
+    
+    MWTime time = 0;
+    int direction;
+    
+    while ((direction = file.get()) != std::char_traits<char>::eof()) {
+        std::uint64_t timeDelta, size;
+        if (direction > BYTE(CaptureDirection::Response) ||
+            !readVarint(file, timeDelta) ||
+            !readVarint(file, size))
+        {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "LED driver capture file is corrupt", path);
+        }
+        
+        time += timeDelta;
+        records.push_back({ CaptureDirection(direction), time, std::vector<BYTE>(size) });
+        
+        auto &data = records.back().data;
+        if (!file.read(reinterpret_cast<char *>(data.data()), data.size())) {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN, "LED driver capture file is truncated", path);
+        }
+        
+        // Every captured request must be a complete frame of a known command
+        CommandInfo info;
+        if (records.back().direction == CaptureDirection::Request &&
+            !(data.size() > 2 && Protocol::lookup(data[2], info) && data.size() == info.requestSize))
+        {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver capture file contains an invalid request "
+                                                 "(transfer %d)") % (records.size() - 1)).str(),
+                                  path);
+        }
+    }
+    
+    // Pair each response with the oldest request still awaiting one.  This must wait until records
+    // stops growing, since the pairs point into it.
+    std::size_t nextUnansweredIndex = 0;
+    for (std::size_t i = 0; i < records.size(); i++) {
+        if (records[i].direction == CaptureDirection::Request) {
+            exchanges.push_back({ &(records[i]), nullptr });
+        } else if (nextUnansweredIndex < exchanges.size()) {
+            exchanges[nextUnansweredIndex++].response = &(records[i]);
+        } else {
+            throw SimpleException(M_IODEVICE_MESSAGE_DOMAIN,
+                                  (boost::format("LED driver capture file contains a response with no request "
+                                                 "(transfer %d)") % i).str(),
+                                  path);
+        }
+    }
+    
+    mprintf(M_IODEVICE_MESSAGE_DOMAIN,
+            "Replaying %lu LED driver transfers from %s",
+            records.size(),
+            path.c_str());
+}
+
+
+bool ReplayTransport::read(BYTE *data, std::size_t size) {
+    PendingResponse response;
+    {
+        std::lock_guard<std::mutex> lock(recordsMutex);
+        if (pendingResponses.empty()) {
+            merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver capture is out of sync with replay (no request awaiting a response)");
+            return false;
+        }
+        response = std::move(pendingResponses.front());
+        pendingResponses.pop_front();
+    }
+    
+    if (response.record && originalTiming) {
+        // Deliver the response with the same delay, relative to its request, that was captured
+        const MWTime delay = response.record->time + response.timeOffset - clock->getCurrentTimeUS();
+        if (delay > 0) {
+            clock->sleepUS(delay);
+        }
+    }
+    
+    static const std::vector<BYTE> noData;
+    const auto &responseData = (response.record ? response.record->data :
+                                !response.synthesizedData.empty() ? response.synthesizedData :
+                                noData);
+    
+    if (responseData.empty()) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "Read from LED driver failed (replayed from capture)");
+        return false;
+    }
+    
+    if (responseData.size() != size) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN,
+               "Incomplete read from LED driver (requested %lu bytes, capture contains %lu)",
+               size,
+               responseData.size());
+        return false;
+    }
+    
+    std::copy(responseData.begin(), responseData.end(), data);
+    return true;
+}
+
+
+bool ReplayTransport::write(const BYTE *data, std::size_t size) {
+    std::lock_guard<std::mutex> lock(recordsMutex);
+    const MWTime currentTime = clock->getCurrentTimeUS();
+    
+    if (size > 2 && data[2] == IsFilePlayingCommand::code()) {
+        return answerPoll(data, currentTime);
+    }
+    
+    // Captured polls that this session didn't make are skipped, but their responses still update
+    // the driver state
+    skipPolls();
+    
+    if (nextExchangeIndex >= exchanges.size()) {
+        merror(M_IODEVICE_MESSAGE_DOMAIN, "LED driver capture is exhausted");
+        return false;
+    }
+    
+    const auto &exchange = exchanges[nextExchangeIndex++];
+    consume(exchange);
+    timeOffset = currentTime - exchange.request->time;
+    pendingResponses.push_back({ exchange.response, timeOffset, {} });
+    
+    const auto &recorded = exchange.request->data;
+    if (!std::equal(data, data + size, recorded.begin(), recorded.end())) {
+        CommandInfo info;
+        mwarning(M_IODEVICE_MESSAGE_DOMAIN,
+                 "%s message sent to LED driver does not match capture (transfer %lu)",
+                 ((size > 2 && Protocol::lookup(data[2], info)) ? info.name : "Unknown"),
+                 std::size_t(exchange.request - records.data()));
+    }
+    
+    return true;
+}
+
+
+bool ReplayTransport::isPoll(const Exchange &exchange) const {
+    return exchange.request->data[2] == IsFilePlayingCommand::code();
+}
+
+
+void ReplayTransport::skipPolls() {
+    while (nextExchangeIndex < exchanges.size() && isPoll(exchanges[nextExchangeIndex])) {
+        consume(exchanges[nextExchangeIndex++]);
+    }
+}
+
+
+void ReplayTransport::consume(const Exchange &exchange) {
+    // Start, stop, and poll responses all report whether a file is playing
+    const auto &request = exchange.request->data;
+    if (exchange.response &&
+        exchange.response->data.size() == IsFilePlayingResponse::size() &&
+        (request[2] == StartFilePlayingCommand::code() ||
+         request[2] == IsFilePlayingCommand::code() ||
+         request[2] == StopFilePlayingCommand::code()))
+    {
+        filePlaying = exchange.response->data[3];
+    }
+}
+
+
+bool ReplayTransport::answerPoll(const BYTE *request, MWTime currentTime) {
+    // With original timing, a poll stands in for the captured polls that were due by now.  Otherwise,
+    // it stands in for all of the captured polls before the next request, so that waits for the
+    // driver to stop end immediately.
+    const Exchange *lastPoll = nullptr;
+    while (nextExchangeIndex < exchanges.size() && isPoll(exchanges[nextExchangeIndex])) {
+        const auto &exchange = exchanges[nextExchangeIndex];
+        if (originalTiming && exchange.request->time + timeOffset > currentTime) {
+            break;
+        }
+        consume(exchange);
+        lastPoll = &exchange;
+        nextExchangeIndex++;
+    }
+    
+    if (lastPoll && lastPoll->response) {
+        pendingResponses.push_back({ lastPoll->response, currentTime - lastPoll->request->time, {} });
+    } else {
+        // Answer with the driver state the capture recorded most recently
+        std::vector<BYTE> response { request[0], request[1], request[2], filePlaying };
+        response.push_back(std::accumulate(response.begin(), response.end(), BYTE(0)));
+        pendingResponses.push_back({ nullptr, 0, std::move(response) });
+    }
+    
+    return true;
+}
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
@@ -0,0 +1,128 @@
+//
+//  BlackrockLEDDriverTransport.hpp
+//  BlackrockLEDDriver
+//
+//  Copyright © 2026 The MWorks Project. All rights reserved.
+//
+
+#ifndef BlackrockLEDDriverTransport_hpp
+#define BlackrockLEDDriverTransport_hpp
+
+#include <fstream>
+
+#include "BlackrockLEDDriverCommand.h"
+
+
+BEGIN_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+class FTDITransport : public Transport {
+    
+public:
+    explicit FTDITransport(FT_HANDLE handle) : handle(handle) { }
+    
+    bool read(BYTE *data, std::size_t size) override;
+    bool write(const BYTE *data, std::size_t size) override;
+    void purge() override;
+    
+private:
+    const FT_HANDLE handle;
+    
+};
+
+
+//
+// Capture files start with captureFileMagic, followed by one record per transfer:
+//
+//   direction (1 byte: 0 = host to device, 1 = device to host)
+//   time since previous record in microseconds (unsigned LEB128)
+//   length in bytes (unsigned LEB128; zero for a failed transfer)
+//   data
+//
+constexpr std::array<char, 8> captureFileMagic { 'B', 'L', 'D', 'C', 'A', 'P', '0', '1' };
+
+enum class CaptureDirection : BYTE {
+    Request = 0,
+    Response = 1
+};
+
+
+class CaptureTransport : public Transport {
+    
+public:
+    CaptureTransport(std::unique_ptr<Transport> transport, const std::string &path);
+    ~CaptureTransport();
+    
+    bool read(BYTE *data, std::size_t size) override;
+    bool write(const BYTE *data, std::size_t size) override;
+    void purge() override { transport->purge(); }
+    
+private:
+    void record(CaptureDirection direction, const BYTE *data, std::size_t size);
+    void writeVarint(std::uint64_t value);
+    
+    const std::unique_ptr<Transport> transport;
+    const boost::shared_ptr<Clock> clock;
+    std::mutex fileMutex;
+    std::ofstream file;
+    MWTime lastRecordTime;
+    
+};
+
+
+//
+// Replays a capture by matching each request with a recorded exchange.  Status polls
+// (IsFilePlaying) are issued by timers, so the number of them varies from session to session.
+// Instead of being matched by position, each poll is answered with the driver state that the
+// capture recorded at the corresponding point.
+//
+class ReplayTransport : public Transport {
+    
+public:
+    ReplayTransport(const std::string &path, bool originalTiming);
+    
+    bool read(BYTE *data, std::size_t size) override;
+    bool write(const BYTE *data, std::size_t size) override;
+    void purge() override { }
+    
+private:
+    struct Record {
+        CaptureDirection direction;
+        MWTime time;
+        std::vector<BYTE> data;
+    };
+    
+    // A captured request and the response to it (the driver responds in request order)
+    struct Exchange {
+        const Record *request;
+        const Record *response;  // Null if the capture contains no response
+    };
+    
+    struct PendingResponse {
+        const Record *record;  // Null if the response is synthesized
+        MWTime timeOffset;
+        std::vector<BYTE> synthesizedData;
+    };
+    
+    bool isPoll(const Exchange &exchange) const;
+    void skipPolls();
+    void consume(const Exchange &exchange);
+    bool answerPoll(const BYTE *request, MWTime currentTime);
+    
+    const bool originalTiming;
+    const boost::shared_ptr<Clock> clock;
+    std::mutex recordsMutex;
+    std::vector<Record> records;
+    std::vector<Exchange> exchanges;
+    std::size_t nextExchangeIndex;
+    std::deque<PendingResponse> pendingResponses;
+    BYTE filePlaying;  // As of the most recently consumed exchange
+    MWTime timeOffset;
+    
+};
+
+
+END_NAMESPACE_MW_BLACKROCK_LEDDRIVER
+
+
+#endif /* BlackrockLEDDriverTransport_hpp */
@@ -0,0 +1,27 @@
+# Publishes one update to the intensity input file, as an external controller
+# would: the drive word in input_word for the single channel input_channel.
+# getvar and setvar are provided by run_python_file.
+
+import mmap
+import struct
+
+
+num_channels = 64
+sequence_offset = 8
+intensity_offset = 16
+mask_offset = intensity_offset + 2 * num_channels
+
+channel_index = getvar('input_channel') - 1
+intensity = [0] * num_channels
+mask = [0] * num_channels
+intensity[channel_index] = getvar('input_word')
+mask[channel_index] = 1
+
+with open(getvar('input_path'), 'r+b') as f:
+    page = mmap.mmap(f.fileno(), 0)
+    sequence = struct.unpack_from('=Q', page, sequence_offset)[0]
+    struct.pack_into('=Q', page, sequence_offset, sequence + 1)
+    struct.pack_into('=%dH' % num_channels, page, intensity_offset, *intensity)
+    struct.pack_into('=%dB' % num_channels, page, mask_offset, *mask)
+    struct.pack_into('=Q', page, sequence_offset, sequence + 2)
+    page.close()
@@ -0,0 +1,27 @@
+# Reads the status page the way an external monitor would, and copies a few
+# fields into MWorks variables for StatusPage.mwel to check.  getvar and setvar
+# are provided by run_python_file.
+
+import mmap
+import struct
+
+
+header = struct.Struct('=4sIQqIIq64H')
+
+with open(getvar('status_path'), 'rb') as f:
+    page = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    while True:
+        start = struct.unpack_from('=Q', page, 8)[0]
+        if start & 1:
+            continue
+        fields = header.unpack_from(page)
+        if struct.unpack_from('=Q', page, 8)[0] == start:
+            break
+    page.close()
+
+magic, version, sequence, update_time, running, samples_used, sample_period = fields[:7]
+setvar('status_valid', magic == b'BLDS' and version == 1 and sequence > 0 and update_time > 0)
+setvar('status_running', running)
+setvar('status_samples_used', samples_used)
+setvar('status_sample_period', sample_period)
+setvar('status_intensity', fields[7])
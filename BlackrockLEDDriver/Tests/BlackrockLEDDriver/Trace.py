@@ -0,0 +1,15 @@
+# Loads the trace written by Trace.mwel and copies a summary into MWorks
+# variables.  getvar and setvar are provided by run_python_file.
+
+import json
+
+
+with open(getvar('trace_path')) as f:
+    events = json.load(f)['traceEvents']
+
+actions = set(e['name'] for e in events if e['ph'] == 'X' and e['cat'] == 'action')
+running = [e['args']['value'] for e in events if e['ph'] == 'C' and e['name'] == 'running']
+
+setvar('trace_has_actions', actions >= {'setIntensity', 'run', 'stop'})
+setvar('trace_has_polls', any(e['ph'] == 'X' and e['name'] == 'status poll' for e in events))
+setvar('trace_running', running)